@@ -0,0 +1,258 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADDRESS_SET_H
+#define ADDRESS_SET_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace clueless
+{
+
+/*
+ * Flat, open-addressing table of addresses. Slots come in groups of
+ * eight that fill one cache line, and a lookup compares a whole group
+ * at once, moving on to the next group only when the group is full.
+ * Address 0 doubles as the empty slot and is kept aside in slot
+ * nslot ().
+ */
+class address_table
+{
+public:
+  size_t
+  size () const
+  {
+    return size_;
+  }
+
+protected:
+  address_table () : groups_ (MIN_GROUPS) {}
+
+  size_t
+  nslot () const
+  {
+    return groups_.size () * GROUP_SIZE;
+  }
+
+  /*
+   * Find the slot holding ADDR, or the empty slot it would be inserted
+   * in. Return the slot and whether ADDR was found.
+   */
+  std::pair<size_t, bool>
+  locate (unsigned long long addr) const
+  {
+    if (!addr)
+      return { nslot (), has_zero_ };
+
+    for (auto g = home_of (addr);; g = (g + 1) & (groups_.size () - 1))
+      {
+        const auto &grp = groups_[g];
+        if (auto found = match (grp, addr))
+          return { g * GROUP_SIZE + std::countr_zero (found), true };
+        if (auto empty = match (grp, 0))
+          return { g * GROUP_SIZE + std::countr_zero (empty), false };
+      }
+  }
+
+  /* Put ADDR in SLOT, an empty slot returned by locate (ADDR) */
+  void
+  claim (size_t slot, unsigned long long addr)
+  {
+    if (slot == nslot ())
+      has_zero_ = true;
+    else
+      groups_[slot / GROUP_SIZE].slot[slot % GROUP_SIZE] = addr;
+    ++size_;
+  }
+
+  unsigned long long
+  address_at (size_t slot) const
+  {
+    if (slot == nslot ())
+      return 0;
+    return groups_[slot / GROUP_SIZE].slot[slot % GROUP_SIZE];
+  }
+
+  bool
+  occupied (size_t slot) const
+  {
+    return slot == nslot () ? has_zero_ : address_at (slot);
+  }
+
+  /* Whether N addresses would fill more than 7/8 of the slots */
+  bool
+  full (size_t n) const
+  {
+    return n * 8 > nslot () * 7;
+  }
+
+  /*
+   * Double the slots, calling MOVE (FROM, TO) for each address that
+   * moves from slot FROM of the old table to slot TO of the new one
+   */
+  template <typename F>
+  void
+  grow (F move)
+  {
+    auto old = std::vector<group> (groups_.size () * 2);
+    old.swap (groups_);
+    --shift_;
+
+    auto old_nslot = old.size () * GROUP_SIZE;
+    if (has_zero_)
+      move (old_nslot, nslot ());
+
+    for (size_t from = 0; from < old_nslot; ++from)
+      if (auto addr = old[from / GROUP_SIZE].slot[from % GROUP_SIZE])
+        {
+          auto to = locate (addr).first;
+          groups_[to / GROUP_SIZE].slot[to % GROUP_SIZE] = addr;
+          move (from, to);
+        }
+  }
+
+private:
+  static constexpr size_t GROUP_SIZE = 8;
+  static constexpr size_t MIN_GROUPS = 16;
+
+  struct alignas (64) group
+  {
+    unsigned long long slot[GROUP_SIZE] = {};
+  };
+
+  /* Bit I is set if slot I of GRP holds ADDR, written to vectorise */
+  static uint32_t
+  match (const group &grp, unsigned long long addr)
+  {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP_SIZE; ++i)
+      mask |= uint32_t (grp.slot[i] == addr) << i;
+    return mask;
+  }
+
+  size_t
+  home_of (unsigned long long addr) const
+  {
+    return (addr * 0x9e3779b97f4a7c15ull) >> shift_;
+  }
+
+  std::vector<group> groups_;
+  int shift_ = 64 - std::countr_zero (MIN_GROUPS);
+  size_t size_ = 0;
+  bool has_zero_ = false;
+};
+
+/* A set of addresses */
+class address_set : public address_table
+{
+public:
+  address_set () = default;
+
+  /* Insert ADDR. Return whether it was not in the set before. */
+  bool
+  insert (unsigned long long addr)
+  {
+    if (full (size () + 1))
+      grow ([] (auto, auto) {});
+
+    auto [slot, found] = locate (addr);
+    if (!found)
+      claim (slot, addr);
+    return !found;
+  }
+};
+
+/* A map from addresses to values of T, kept apart from the addresses */
+template <typename T> class address_map : public address_table
+{
+public:
+  address_map () : values_ (nslot () + 1) {}
+
+  /*
+   * Map ADDR to VALUE unless it is mapped already. Return the value
+   * ADDR maps to and whether it was inserted.
+   */
+  std::pair<T &, bool>
+  try_emplace (unsigned long long addr, T value)
+  {
+    if (full (size () + 1))
+      grow ();
+
+    auto [slot, found] = locate (addr);
+    if (!found)
+      {
+        claim (slot, addr);
+        values_[slot] = std::move (value);
+      }
+    return { values_[slot], !found };
+  }
+
+  /*
+   * Make room for N addresses up front. Filling a small map while
+   * walking a big one in slot order inserts in hash order, which piles
+   * the addresses into long probe chains unless the room is there.
+   */
+  void
+  reserve (size_t n)
+  {
+    while (full (n))
+      grow ();
+  }
+
+  /* Call F (ADDR, VALUE) for each address in the map */
+  template <typename F>
+  void
+  for_each (F f) const
+  {
+    for (size_t slot = 0; slot <= nslot (); ++slot)
+      if (occupied (slot))
+        f (address_at (slot), values_[slot]);
+  }
+
+  template <typename F>
+  void
+  for_each (F f)
+  {
+    for (size_t slot = 0; slot <= nslot (); ++slot)
+      if (occupied (slot))
+        f (address_at (slot), values_[slot]);
+  }
+
+private:
+  void
+  grow ()
+  {
+    auto values = std::vector<T> (nslot () * 2 + 1);
+    address_table::grow ([&] (auto from, auto to) {
+      values[to] = std::move (values_[from]);
+    });
+    values_.swap (values);
+  }
+
+  std::vector<T> values_;
+};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async-tracereader.h"
+#include <algorithm>
+#include <utility>
+
+namespace clueless
+{
+
+async_tracereader::async_tracereader (const char *trace_string,
+                                      unsigned nthread)
+    : reader_ (trace_string, nthread)
+{
+}
+
+async_tracereader::~async_tracereader ()
+{
+  if (!producer_.joinable ())
+    return;
+
+  stop_ = true;
+
+  /*
+   * The producer re-checks stop_ after every block it publishes, so it
+   * needs at most one more free slot to get there.
+   */
+  if (holding_ || !ring_->empty ())
+    ring_->pop ();
+
+  producer_.join ();
+}
+
+input_instr
+async_tracereader::read_single_instr ()
+{
+  if (current_.empty ())
+    acquire ();
+
+  auto ins = current_.front ();
+  current_ = current_.subspan (1);
+  return ins;
+}
+
+std::span<const input_instr>
+async_tracereader::next_block ()
+{
+  if (current_.empty ())
+    acquire ();
+
+  return std::exchange (current_, {});
+}
+
+void
+async_tracereader::skip (size_t n)
+{
+  if (!producer_.joinable ())
+    {
+      reader_.skip (n);
+      return;
+    }
+
+  while (n)
+    {
+      if (current_.empty ())
+        acquire ();
+
+      auto nskipped = std::min (n, current_.size ());
+      current_ = current_.subspan (nskipped);
+      n -= nskipped;
+    }
+}
+
+void
+async_tracereader::acquire ()
+{
+  /* The producer starts on the first read so that skip () can seek */
+  if (!producer_.joinable ())
+    producer_ = std::thread{ [this] { produce (); } };
+
+  if (holding_)
+    ring_->pop ();
+
+  current_ = ring_->front ();
+  holding_ = true;
+}
+
+void
+async_tracereader::produce ()
+{
+  while (!stop_)
+    {
+      reader_.read_batch (ring_->back ());
+      ring_->push ();
+    }
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASYNC_TRACEREADER_H
+#define ASYNC_TRACEREADER_H
+
+#include "spsc-ring.h"
+#include "trace-instruction.h"
+#include "tracereader.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <thread>
+
+namespace clueless
+{
+
+/*
+ * A tracereader that decompresses on a separate thread. Blocks of
+ * records are handed over through a lock-free ring, so decompression
+ * overlaps with whatever the caller does with the previous block.
+ */
+class async_tracereader
+{
+public:
+  explicit async_tracereader (const char *trace_string, unsigned nthread = 1);
+  async_tracereader (const async_tracereader &other) = delete;
+  ~async_tracereader ();
+
+  input_instr read_single_instr ();
+
+  /*
+   * Return the next block of records without copying them. The block
+   * stays valid until the next read from this reader.
+   */
+  std::span<const input_instr> next_block ();
+
+  /*
+   * Skip the next N records. Before the first read this jumps ahead
+   * like tracereader::skip, afterwards it drains the read-ahead.
+   */
+  void skip (size_t n);
+
+private:
+  static constexpr size_t BLOCK_SIZE = 1 << 12;
+  static constexpr size_t NBLOCK = 8;
+
+  using block = std::array<input_instr, BLOCK_SIZE>;
+
+  void produce ();
+  void acquire ();
+
+  tracereader reader_;
+  std::unique_ptr<spsc_ring<block, NBLOCK> > ring_
+      = std::make_unique<spsc_ring<block, NBLOCK> > ();
+  std::span<const input_instr> current_ = {};
+  bool holding_ = false;
+  std::atomic<bool> stop_ = false;
+  std::thread producer_;
+};
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "champsim-trace-decoder.h"
+#include "decompressor.h"
+#include "trace-cache.h"
+#include "trace-instruction.h"
+#include <algorithm>
+#include <argp.h>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <vector>
+
+const char *argp_program_version = "cache-trace 0.1.0";
+const char *argp_program_bug_address = "<xchen@vvvu.org>";
+
+static char doc[]
+    = "Decode a trace once into a clueless trace cache\v"
+      "how-address and reuse-distance accept the CACHE in place of the "
+      "TRACE and replay it without decompressing or decoding.";
+
+static char args_doc[] = "TRACE CACHE";
+
+const struct argp_option option[]
+    = { { "simulate", 's', "N", 0, "Cache the first N instructions" },
+        { "jobs", 'j', "N", 0, "Decompress blocks of the trace on N threads" },
+        { 0 } };
+
+struct knobs
+{
+  size_t nsimulate = std::numeric_limits<size_t>::max ();
+  unsigned njob = 1;
+  char *trace_file = nullptr;
+  char *cache_file = nullptr;
+};
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  auto knbs = (knobs *)state->input;
+
+  switch (key)
+    {
+    case 's':
+      knbs->nsimulate = atoll (arg);
+      break;
+
+    case 'j':
+      knbs->njob = atoi (arg);
+      break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num >= 2)
+        argp_usage (state);
+
+      (state->arg_num ? knbs->cache_file : knbs->trace_file) = arg;
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num < 2)
+        argp_usage (state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
+static struct argp argp = { option, parse_opt, args_doc, doc };
+
+int
+main (int argc, char *argv[])
+{
+  auto knbs = knobs{};
+
+  argp_parse (&argp, argc, argv, 0, 0, &knbs);
+
+  using namespace clueless;
+
+  auto c = compression_of (knbs.trace_file);
+  if (!c)
+    {
+      std::cerr << "Traces must be gz, xz or zst compressed!" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  auto in = open_decompressor (knbs.trace_file, *c, knbs.njob);
+  auto decoder = champsim_trace_decoder{};
+  auto writer = trace_cache_writer{ knbs.cache_file };
+
+  auto buffer = std::vector<input_instr> (1 << 14);
+  for (auto i = size_t{ 0 }; i < knbs.nsimulate;)
+    {
+      auto n = in->read ((char *)buffer.data (),
+                         buffer.size () * sizeof (input_instr))
+               / sizeof (input_instr);
+      if (!n)
+        break;
+
+      for (const auto &input_ins :
+           std::span{ buffer }.first (std::min (n, knbs.nsimulate - i)))
+        {
+          writer.write (decoder.decode (input_ins));
+          ++i;
+        }
+    }
+}
@@ -43,7 +43,10 @@ champsim_trace_decoder::decode (const input_instr &input)
 
   reset ();
 
+  auto compact_of = [this] (auto reg) { return compact (reg); };
+
   ins_.ip = input.ip;
+  ins_.seq = i_++;
 
   if (input.is_branch)
     {
@@ -58,11 +61,13 @@ champsim_trace_decoder::decode (const input_instr &input)
     {
       ins_.op = propagator::instr::opcode::OP_REG;
 
-      copy (input.source_registers | views::filter (reg_pred),
-            back_inserter (ins_.src_reg));
+      copy (input.source_registers | views::filter (reg_pred)
+                | views::transform (compact_of),
+            std::back_inserter (ins_.src_reg));
 
-      copy (input.destination_registers | views::filter (reg_pred),
-            back_inserter (ins_.dst_reg));
+      copy (input.destination_registers | views::filter (reg_pred)
+                | views::transform (compact_of),
+            std::back_inserter (ins_.dst_reg));
     }
   else if (src_mem && !dst_mem)
     {
@@ -71,11 +76,12 @@ champsim_trace_decoder::decode (const input_instr &input)
       copy (input.source_registers | views::filter ([=] (auto reg) {
               return reg_pred (reg)
                      && !count (input.destination_registers, reg);
-            }),
-            back_inserter (ins_.mem_reg));
+            }) | views::transform (compact_of),
+            std::back_inserter (ins_.mem_reg));
 
-      copy (input.destination_registers | views::filter (reg_pred),
-            back_inserter (ins_.dst_reg));
+      copy (input.destination_registers | views::filter (reg_pred)
+                | views::transform (compact_of),
+            std::back_inserter (ins_.dst_reg));
 
       ins_.address = src_mem;
     }
@@ -86,14 +92,15 @@ champsim_trace_decoder::decode (const input_instr &input)
       /* push or call */
       if (any_of (input.destination_registers, std::identity{}))
         {
-          ins_.mem_reg.push_back (REG_STACK_POINTER);
+          ins_.mem_reg.push_back (compact (REG_STACK_POINTER));
         }
       else
         {
           copy (subrange (begin (input.source_registers),
                           rbegin (input.source_registers).base ())
-                    | views::filter (reg_pred),
-                back_inserter (ins_.mem_reg));
+                    | views::filter (reg_pred)
+                    | views::transform (compact_of),
+                std::back_inserter (ins_.mem_reg));
         }
 
       ins_.address = dst_mem;
@@ -110,6 +117,15 @@ champsim_trace_decoder::decode (const input_instr &input)
   return ins_;
 }
 
+unsigned char
+champsim_trace_decoder::compact (unsigned char reg)
+{
+  auto &id = compact_[reg];
+  if (!id)
+    id = ++nreg_;
+  return id - 1;
+}
+
 void
 champsim_trace_decoder::reset ()
 {
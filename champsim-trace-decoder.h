@@ -24,19 +24,42 @@
 #include "propagator.h"
 #include "trace-instruction.h"
 
+#include <array>
+#include <cstddef>
+
 namespace clueless
 {
 
+/*
+ * Decodes ChampSim trace records into propagator instructions. The
+ * registers of the decoded instructions are numbered densely in the
+ * order they first appear in the trace, so the few dozen registers a
+ * trace actually uses fit a compact propagator.
+ */
 class champsim_trace_decoder
 {
 public:
   const propagator::instr &decode (const input_instr &input);
 
+  /* Return the number of distinct registers seen so far */
+  size_t
+  nreg () const
+  {
+    return nreg_;
+  }
+
 private:
   void reset ();
 
+  /* Return the compact number of architectural register REG */
+  unsigned char compact (unsigned char reg);
+
   propagator::instr ins_ = {};
   unsigned long long i_ = {};
+
+  /* Compact number + 1 of each architectural register, or 0 if unseen */
+  std::array<unsigned char, 256> compact_ = {};
+  size_t nreg_ = 0;
 };
 
 }
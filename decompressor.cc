@@ -0,0 +1,406 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decompressor.h"
+#include "trace-index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace clueless
+{
+
+static constexpr size_t INPUT_BUFFER_SIZE = 1 << 20;
+
+static void
+cannot_open (const std::string &path)
+{
+  std::cerr << std::endl
+            << "*** CANNOT OPEN TRACE FILE: " << path << " ***" << std::endl;
+  assert (0);
+}
+
+static void
+corrupted (const std::string &path)
+{
+  std::cerr << std::endl
+            << "*** CORRUPTED TRACE FILE: " << path << " ***" << std::endl;
+  assert (0);
+}
+
+size_t
+decompressor::skip (size_t n)
+{
+  auto scratch = std::vector<char> (std::min (n, INPUT_BUFFER_SIZE));
+  size_t nskipped = 0;
+  while (nskipped < n)
+    {
+      auto len
+          = read (scratch.data (), std::min (n - nskipped, scratch.size ()));
+      if (!len)
+        break;
+      nskipped += len;
+    }
+  return nskipped;
+}
+
+class popen_decompressor : public decompressor
+{
+public:
+  popen_decompressor (const std::string &path, compression c)
+  {
+    const char *program = c == compression::GZIP ? "gzip"
+                          : c == compression::XZ ? "xz"
+                                                 : "zstd";
+    /* Quote PATH for the shell, closing the quotes around any in it */
+    auto cmd = std::string{ program } + " -dc '";
+    for (auto ch : path)
+      if (ch == '\'')
+        cmd += "'\\''";
+      else
+        cmd += ch;
+    cmd += "'";
+    file_ = popen (cmd.c_str (), "r");
+    if (file_ == NULL)
+      cannot_open (path);
+  }
+
+  ~popen_decompressor () { pclose (file_); }
+
+  size_t
+  read (char *buf, size_t n) override
+  {
+    return fread (buf, 1, n, file_);
+  }
+
+private:
+  FILE *file_ = NULL;
+};
+
+#ifdef HAVE_ZLIB
+class gzip_decompressor : public decompressor
+{
+public:
+  explicit gzip_decompressor (const std::string &path)
+      : path_ (path), in_ (INPUT_BUFFER_SIZE)
+  {
+    file_ = fopen (path.c_str (), "rb");
+    if (file_ == NULL)
+      cannot_open (path);
+    if (inflateInit2 (&strm_, 15 + 32) != Z_OK)
+      cannot_open (path);
+  }
+
+  ~gzip_decompressor ()
+  {
+    inflateEnd (&strm_);
+    fclose (file_);
+  }
+
+  size_t
+  read (char *buf, size_t n) override
+  {
+    strm_.next_out = (Bytef *)buf;
+    strm_.avail_out = std::min (n, size_t{ UINT_MAX });
+
+    while (strm_.avail_out && !done_)
+      {
+        if (!strm_.avail_in)
+          fill ();
+
+        /*
+         * Only next_member () finds the end of the input. Out of input
+         * before that, inflate () makes no progress and the member is
+         * truncated.
+         */
+        auto ret = inflate (&strm_, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+          next_member ();
+        else if (ret != Z_OK)
+          corrupted (path_);
+      }
+
+    auto nread = size_t ((char *)strm_.next_out - buf);
+    out_ += nread;
+    return nread < n && !done_ ? nread + read (buf + nread, n - nread)
+                               : nread;
+  }
+
+  size_t
+  skip (size_t n) override
+  {
+    if (!index_loaded_)
+      {
+        index_.load (path_);
+        index_loaded_ = true;
+      }
+
+    auto start = out_, target = out_ + n;
+    if (auto point = index_.find (target); point && point->out > out_)
+      jump (*point);
+
+    decompressor::skip (target - out_);
+    return out_ - start;
+  }
+
+private:
+  bool
+  fill ()
+  {
+    strm_.next_in = in_.data ();
+    strm_.avail_in = fread (in_.data (), 1, in_.size (), file_);
+    return strm_.avail_in;
+  }
+
+  /* Move on to the gzip member after the one just finished, if any */
+  void
+  next_member ()
+  {
+    /* A raw deflate stream leaves the gzip trailer to us */
+    for (auto trailer = raw_ ? 8 : 0; trailer;)
+      {
+        if (!strm_.avail_in && !fill ())
+          corrupted (path_);
+        auto len = std::min (trailer, (int)strm_.avail_in);
+        strm_.next_in += len;
+        strm_.avail_in -= len;
+        trailer -= len;
+      }
+
+    if (!strm_.avail_in && !fill ())
+      done_ = true;
+    else if (inflateReset2 (&strm_, 15 + 32) != Z_OK)
+      corrupted (path_);
+    raw_ = false;
+  }
+
+  /* Restart decompression at POINT as a raw deflate stream */
+  void
+  jump (const gzip_access_point &point)
+  {
+    if (fseek (file_, point.in - (point.bits ? 1 : 0), SEEK_SET)
+        || inflateReset2 (&strm_, -15) != Z_OK)
+      corrupted (path_);
+
+    strm_.avail_in = 0;
+    if (point.bits)
+      {
+        auto c = getc (file_);
+        if (c == EOF
+            || inflatePrime (&strm_, point.bits, c >> (8 - point.bits))
+                   != Z_OK)
+          corrupted (path_);
+      }
+
+    if (inflateSetDictionary (&strm_, point.window, sizeof (point.window))
+        != Z_OK)
+      corrupted (path_);
+
+    out_ = point.out;
+    raw_ = true;
+    done_ = false;
+  }
+
+  FILE *file_ = NULL;
+  std::string path_;
+  std::vector<uint8_t> in_;
+  z_stream strm_ = {};
+  uint64_t out_ = 0;
+  bool raw_ = false;
+  bool done_ = false;
+  gzip_index index_;
+  bool index_loaded_ = false;
+};
+#endif
+
+#ifdef HAVE_LZMA
+class xz_decompressor : public decompressor
+{
+public:
+  explicit xz_decompressor (const std::string &path)
+      : path_ (path), in_ (INPUT_BUFFER_SIZE)
+  {
+    file_ = fopen (path.c_str (), "rb");
+    if (file_ == NULL)
+      cannot_open (path);
+    if (lzma_stream_decoder (&strm_, UINT64_MAX, LZMA_CONCATENATED)
+        != LZMA_OK)
+      cannot_open (path);
+  }
+
+  ~xz_decompressor ()
+  {
+    lzma_end (&strm_);
+    fclose (file_);
+  }
+
+  size_t
+  read (char *buf, size_t n) override
+  {
+    strm_.next_out = (uint8_t *)buf;
+    strm_.avail_out = n;
+
+    while (strm_.avail_out && !done_)
+      {
+        if (!strm_.avail_in && !feof (file_))
+          {
+            strm_.next_in = in_.data ();
+            strm_.avail_in = fread (in_.data (), 1, in_.size (), file_);
+          }
+
+        auto ret = lzma_code (&strm_, feof (file_) ? LZMA_FINISH : LZMA_RUN);
+        if (ret == LZMA_STREAM_END)
+          done_ = true;
+        else if (ret != LZMA_OK)
+          corrupted (path_);
+      }
+
+    return n - strm_.avail_out;
+  }
+
+private:
+  FILE *file_ = NULL;
+  std::string path_;
+  std::vector<uint8_t> in_;
+  lzma_stream strm_ = LZMA_STREAM_INIT;
+  bool done_ = false;
+};
+#endif
+
+#ifdef HAVE_ZSTD
+class zstd_decompressor : public decompressor
+{
+public:
+  explicit zstd_decompressor (const std::string &path)
+      : path_ (path), in_ (ZSTD_DStreamInSize ())
+  {
+    file_ = fopen (path.c_str (), "rb");
+    if (file_ == NULL)
+      cannot_open (path);
+    dstream_ = ZSTD_createDStream ();
+    if (dstream_ == NULL)
+      cannot_open (path);
+  }
+
+  ~zstd_decompressor ()
+  {
+    ZSTD_freeDStream (dstream_);
+    fclose (file_);
+  }
+
+  size_t
+  read (char *buf, size_t n) override
+  {
+    auto out = ZSTD_outBuffer{ buf, n, 0 };
+
+    while (out.pos < out.size)
+      {
+        if (input_.pos == input_.size)
+          {
+            input_.size = fread (in_.data (), 1, in_.size (), file_);
+            input_.src = in_.data ();
+            input_.pos = 0;
+            /* The input may only end between frames */
+            if (!input_.size && !ret_)
+              break;
+          }
+
+        auto pos = out.pos;
+        ret_ = ZSTD_decompressStream (dstream_, &out, &input_);
+        if (ZSTD_isError (ret_) || (!input_.size && out.pos == pos))
+          corrupted (path_);
+      }
+
+    return out.pos;
+  }
+
+private:
+  FILE *file_ = NULL;
+  std::string path_;
+  std::vector<char> in_;
+  ZSTD_inBuffer input_ = {};
+  ZSTD_DStream *dstream_ = NULL;
+  /* What ZSTD_decompressStream () last returned, 0 at the end of a frame */
+  size_t ret_ = 1;
+};
+#endif
+
+std::optional<compression>
+compression_of (const std::string &path)
+{
+  auto last_dot = path.find_last_of (".");
+  if (last_dot == std::string::npos || last_dot + 1 == path.size ())
+    return std::nullopt;
+
+  switch (path[last_dot + 1])
+    {
+    case 'g':
+      return compression::GZIP;
+    case 'x':
+      return compression::XZ;
+    case 'z':
+      return compression::ZSTD;
+    default:
+      return std::nullopt;
+    }
+}
+
+std::unique_ptr<decompressor>
+open_decompressor (const std::string &path, compression c, unsigned nthread)
+{
+  if (auto parallel = open_parallel_decompressor (path, c, nthread))
+    return parallel;
+
+  switch (c)
+    {
+#ifdef HAVE_ZLIB
+    case compression::GZIP:
+      return std::make_unique<gzip_decompressor> (path);
+#endif
+#ifdef HAVE_LZMA
+    case compression::XZ:
+      return std::make_unique<xz_decompressor> (path);
+#endif
+#ifdef HAVE_ZSTD
+    case compression::ZSTD:
+      return std::make_unique<zstd_decompressor> (path);
+#endif
+    default:
+      return std::make_unique<popen_decompressor> (path, c);
+    }
+}
+
+}
@@ -0,0 +1,84 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace clueless
+{
+
+enum class compression
+{
+  GZIP,
+  XZ,
+  ZSTD,
+};
+
+/* Tell the compression of PATH from its extension */
+std::optional<compression> compression_of (const std::string &path);
+
+class decompressor
+{
+public:
+  virtual ~decompressor () = default;
+
+  /*
+   * Decompress up to N bytes into BUF. Return the number of bytes
+   * written, which is only short of N at the end of the stream.
+   */
+  virtual size_t read (char *buf, size_t n) = 0;
+
+  /*
+   * Skip N bytes of the stream. Return the number of bytes skipped,
+   * which is only short of N at the end of the stream. Backends that
+   * know where to restart decompression jump instead of decompressing
+   * everything in between.
+   */
+  virtual size_t skip (size_t n);
+};
+
+/*
+ * Open PATH with an in-process decoder for C if one is compiled in,
+ * otherwise fall back to piping it through "gzip -dc", "xz -dc" or
+ * "zstd -dc". Multi-block xz and multi-frame zstd files are
+ * decompressed on NTHREAD worker threads, which also lets skip ()
+ * jump straight to the block it lands in.
+ */
+std::unique_ptr<decompressor> open_decompressor (const std::string &path,
+                                                 compression c,
+                                                 unsigned nthread = 1);
+
+/*
+ * Open PATH for decompression on NTHREAD worker threads, one
+ * independently compressed block at a time. Return nullptr if PATH
+ * holds a single block or its format cannot be split.
+ */
+std::unique_ptr<decompressor>
+open_parallel_decompressor (const std::string &path, compression c,
+                            unsigned nthread);
+
+}
+
+#endif
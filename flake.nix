@@ -9,6 +9,8 @@
       packages.x86_64-linux.clueless-trace = stdenv.mkDerivation {
         name = "clueless";
         src = self;
+        nativeBuildInputs = [ pkg-config ];
+        buildInputs = [ zlib xz zstd ];
         makeFlags = [ "PREFIX=$(out)" ];
       };
       packages.x86_64-linux.default = self.packages.x86_64-linux.clueless-trace;
@@ -18,15 +18,18 @@
  * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "address-set.h"
+#include "async-tracereader.h"
 #include "champsim-trace-decoder.h"
 #include "propagator.h"
+#include "trace-cache.h"
 #include "tracereader.h"
+#include <algorithm>
 #include <argp.h>
 #include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
-#include <unordered_set>
 
 const char *argp_program_version = "how-address 0.1.0";
 const char *argp_program_bug_address = "<xchen@vvvu.org>";
@@ -39,6 +42,10 @@ const struct argp_option option[]
     = { { "warmup", 'w', "N", 0, "Skip the first N instructions" },
         { "simulate", 's', "N", 0, "Simulate N instructions" },
         { "heartbeat", 'b', "N", 0, "Print heartbeat every N instructions" },
+        { "pipeline", 'p', 0, 0, "Decompress the trace on a separate thread" },
+        { "jobs", 'j', "N", 0, "Decompress blocks of the trace on N threads" },
+        { "taints", 't', "N", 0,
+          "Track N taints at once: 64, 256, 1024 (default) or 4096" },
         { 0 } };
 
 struct knobs
@@ -46,6 +53,9 @@ struct knobs
   size_t nwarmup = 0;
   size_t nsimulate = 10000000;
   size_t heartbeat = 100000;
+  bool pipeline = false;
+  unsigned njob = 1;
+  size_t ntaint = clueless::taint::N;
   char *trace_file = nullptr;
 };
 
@@ -68,6 +78,21 @@ parse_opt (int key, char *arg, struct argp_state *state)
       knbs->heartbeat = atoll (arg);
       break;
 
+    case 'p':
+      knbs->pipeline = true;
+      break;
+
+    case 'j':
+      knbs->njob = atoi (arg);
+      break;
+
+    case 't':
+      knbs->ntaint = atoll (arg);
+      if (std::ranges::find (clueless::PROPAGATOR_CAPACITIES, knbs->ntaint)
+          == end (clueless::PROPAGATOR_CAPACITIES))
+        argp_error (state, "unsupported number of taints: %s", arg);
+      break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num >= 1)
         argp_usage (state);
@@ -96,94 +121,120 @@ main (int argc, char *argv[])
   argp_parse (&argp, argc, argv, 0, 0, &knbs);
 
   using namespace clueless;
-  auto reader = tracereader{ knbs.trace_file };
-  auto decoder = champsim_trace_decoder{};
-  static auto pp = propagator{};
-
-  auto level_leaked = std::array<std::unordered_set<unsigned long long>, 4>{};
-  auto num_taint = std::array<std::unordered_set<unsigned long long>, 8>{};
-  auto all = std::unordered_set<unsigned long long>{};
-
-  pp.add_secret_exposed_hook ([&] (auto param) {
-    auto &&[exposed_secret, transmit_addr, transmit_ip] = param;
 
-    using namespace std::ranges;
-
-    auto &num_taint_set = exposed_secret.size () < num_taint.size ()
-                              ? num_taint[exposed_secret.size () - 1]
-                              : *num_taint.rbegin ();
-
-    for (auto &sec : exposed_secret)
+  /* The column each secret and transmit address was first counted in */
+  auto level_leaked = address_map<uint8_t>{};
+  auto num_taint = address_map<uint8_t>{};
+  auto all = address_set{};
+
+  /* Running totals of the printed columns, kept up on every insert */
+  struct
+  {
+    std::array<size_t, 4> level_leaked;
+    std::array<size_t, 8> num_taint;
+    size_t gtt;
+    size_t all;
+  } columns = {};
+
+  auto count_first_seen
+      = [] (auto &map, auto &count, auto addr, size_t column) {
+          column = std::min (column, count.size () - 1);
+          auto inserted = map.try_emplace (addr, column).second;
+          count[column] += inserted;
+          return inserted;
+        };
+
+  auto record_batch = [&] (const auto &batch) {
+    for (size_t event = 0; event < batch.nevent (); ++event)
       {
-        if (find_if (
-                level_leaked,
-                [=] (auto &set) { return set.contains (sec.secret_address); })
-            != end (level_leaked))
-          {
-            continue;
-          }
-
-        auto &lvl_set = sec.propagation_level < level_leaked.size () - 1
-                            ? level_leaked[sec.propagation_level]
-                            : *level_leaked.rbegin ();
-
-        lvl_set.insert (sec.secret_address);
-      }
+        auto first = batch.secret_begin (event);
+        auto last = batch.secret_end[event];
 
-    if (find_if (num_taint,
-                 [=] (auto &set) { return set.contains (transmit_addr); })
-        == end (num_taint))
-      {
-        num_taint_set.insert (transmit_addr);
+        for (auto sec = first; sec < last; ++sec)
+          columns.gtt += count_first_seen (
+              level_leaked, columns.level_leaked, batch.secret_address[sec],
+              batch.propagation_level[sec]);
+
+        count_first_seen (num_taint, columns.num_taint,
+                          batch.transmit_address[event], last - first - 1);
       }
-  });
+  };
 
   auto print_header = [] {
     printf ("ins lvl0 lvl1 lvl2 lvl3+ t1 t2 t3 t4 t5 t6 t7 t8+ gtt all\n");
   };
   auto print_result = [&] (auto i) {
-    auto global_taint_tracking = std::unordered_set<unsigned long long>{};
-    using namespace std::ranges;
-    for_each (level_leaked, [&] (const auto &set) {
-      for_each (set, [&] (auto pair) { global_taint_tracking.insert (pair); });
-    });
     printf ("%zu ", i);
-    for (auto &set : level_leaked)
-      printf ("%zu ", set.size ());
-    for (auto &set : num_taint)
-      printf ("%zu ", set.size ());
-    printf ("%zu ", global_taint_tracking.size ());
-    printf ("%zu", all.size ());
+    for (auto n : columns.level_leaked)
+      printf ("%zu ", n);
+    for (auto n : columns.num_taint)
+      printf ("%zu ", n);
+    printf ("%zu ", columns.gtt);
+    printf ("%zu", columns.all);
     printf ("\n");
     fflush (stdout);
   };
 
-  for (auto i = size_t{ 0 }; i < knbs.nwarmup; ++i)
-    {
-      reader.read_single_instr ();
-    }
+  auto run = [&] (auto &pp) {
+    auto simulate = [&] (auto &reader, auto &decoder) {
+      reader.skip (knbs.nwarmup);
 
-  print_header ();
+      print_header ();
 
-  for (auto i = size_t{ 0 }; i < knbs.nsimulate; ++i)
-    {
-      if (!(i % knbs.heartbeat))
+      auto next_heartbeat = size_t{ 0 };
+      for (auto i = size_t{ 0 }; i < knbs.nsimulate;)
         {
-          print_result (i);
+          auto block = reader.next_block ();
+          for (const auto &input_ins :
+               block.first (std::min (block.size (), knbs.nsimulate - i)))
+            {
+              if (i == next_heartbeat)
+                {
+                  pp.flush_batch (record_batch);
+                  print_result (i);
+                  next_heartbeat += knbs.heartbeat;
+                }
+
+              const auto &decoded_ins = decoder.decode (input_ins);
+              pp.propagate_batched (decoded_ins, record_batch);
+              if (decoded_ins.op == propagator::instr::opcode::OP_STORE)
+                {
+                  columns.all += all.insert (decoded_ins.address);
+                }
+              else if (decoded_ins.op == propagator::instr::opcode::OP_LOAD)
+                {
+                  columns.all += all.insert (decoded_ins.address);
+                }
+
+              ++i;
+            }
         }
 
-      auto input_ins = reader.read_single_instr ();
-      const auto &decoded_ins = decoder.decode (input_ins);
-      pp.propagate (decoded_ins);
-      if (decoded_ins.op == propagator::instr::opcode::OP_STORE)
-        {
-          all.insert (decoded_ins.address);
-        }
-      else if (decoded_ins.op == propagator::instr::opcode::OP_LOAD)
-        {
-          all.insert (decoded_ins.address);
-        }
-    }
+      pp.flush_batch (record_batch);
+      print_result (knbs.nsimulate);
+    };
+
+    if (trace_cache_reader::is_trace_cache (knbs.trace_file))
+      {
+        auto reader = trace_cache_reader{ knbs.trace_file };
+        auto decoder = trace_cache_decoder{};
+        simulate (reader, decoder);
+      }
+    else if (knbs.pipeline)
+      {
+        auto reader = async_tracereader{ knbs.trace_file, knbs.njob };
+        auto decoder = champsim_trace_decoder{};
+        simulate (reader, decoder);
+      }
+    else
+      {
+        auto reader = tracereader{ knbs.trace_file, knbs.njob };
+        auto decoder = champsim_trace_decoder{};
+        simulate (reader, decoder);
+      }
+
+    report_propagation_stats (pp.stats ());
+  };
 
-  print_result (knbs.nsimulate);
+  with_propagator (knbs.ntaint, run);
 }
@@ -0,0 +1,118 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decompressor.h"
+#include "trace-index.h"
+#include "trace-instruction.h"
+#include <argp.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+const char *argp_program_version = "index-trace 0.1.0";
+const char *argp_program_bug_address = "<xchen@vvvu.org>";
+
+static char doc[]
+    = "Index a gzip trace so that --warmup can jump ahead in it\v"
+      "The index is written to TRACE.idx. Multi-block xz and seekable zstd "
+      "traces carry their own block index and need no sidecar; see "
+      "recompress-trace.";
+
+static char args_doc[] = "TRACE";
+
+const struct argp_option option[]
+    = { { "span", 'n', "N", 0,
+          "Place an access point every N instructions (default 1048576)" },
+        { 0 } };
+
+struct knobs
+{
+  size_t span = 1 << 20;
+  char *trace_file = nullptr;
+};
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  auto knbs = (knobs *)state->input;
+
+  switch (key)
+    {
+    case 'n':
+      knbs->span = atoll (arg);
+      break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num >= 1)
+        argp_usage (state);
+
+      knbs->trace_file = arg;
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num < 1)
+        argp_usage (state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
+static struct argp argp = { option, parse_opt, args_doc, doc };
+
+int
+main (int argc, char *argv[])
+{
+  auto knbs = knobs{};
+
+  argp_parse (&argp, argc, argv, 0, 0, &knbs);
+
+  using namespace clueless;
+
+  if (compression_of (knbs.trace_file) != compression::GZIP)
+    {
+      std::cerr << "Only gzip traces need an index; xz and zstd traces are "
+                   "indexed by their blocks"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  auto index = gzip_index{};
+  if (!index.build (knbs.trace_file, knbs.span * sizeof (input_instr)))
+    {
+      std::cerr << "*** CANNOT INDEX TRACE FILE: " << knbs.trace_file
+                << " ***" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (!index.save (knbs.trace_file))
+    {
+      std::cerr << "*** CANNOT WRITE INDEX: "
+                << gzip_index::path_of (knbs.trace_file) << " ***"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  printf ("%zu access points written to %s\n", index.size (),
+          gzip_index::path_of (knbs.trace_file).c_str ());
+}
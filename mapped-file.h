@@ -0,0 +1,86 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <span>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clueless
+{
+
+/* A read-only memory mapping of a whole file */
+class mapped_file
+{
+public:
+  explicit mapped_file (const std::string &path)
+  {
+    auto fd = open (path.c_str (), O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat st;
+    if (!fstat (fd, &st) && st.st_size)
+      {
+        auto addr = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+          {
+            madvise (addr, st.st_size, MADV_SEQUENTIAL);
+            data_ = { (const uint8_t *)addr, (size_t)st.st_size };
+          }
+      }
+
+    ::close (fd);
+  }
+
+  mapped_file (const mapped_file &other) = delete;
+
+  ~mapped_file ()
+  {
+    if (!data_.empty ())
+      munmap ((void *)data_.data (), data_.size ());
+  }
+
+  bool
+  good () const
+  {
+    return !data_.empty ();
+  }
+
+  std::span<const uint8_t>
+  data () const
+  {
+    return data_;
+  }
+
+private:
+  std::span<const uint8_t> data_ = {};
+};
+
+}
+
+#endif
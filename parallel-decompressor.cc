@@ -0,0 +1,419 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decompressor.h"
+#include "mapped-file.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace clueless
+{
+
+struct compressed_block
+{
+  size_t offset;
+  size_t size;
+  size_t uncompressed_size;
+  unsigned long long tag; /* format specific, e.g. the xz check */
+};
+
+using block_decode_function = bool (*) (const compressed_block &block,
+                                        const uint8_t *in, uint8_t *out);
+
+/*
+ * Decompress independent blocks of a file on a pool of worker threads
+ * and deliver them in file order. At most WINDOW blocks are decoded
+ * ahead of the reader.
+ */
+class parallel_decompressor : public decompressor
+{
+public:
+  parallel_decompressor (const std::string &path,
+                         std::unique_ptr<mapped_file> file,
+                         std::vector<compressed_block> blocks,
+                         block_decode_function decode, unsigned nthread)
+      : path_ (path), file_ (std::move (file)), blocks_ (std::move (blocks)),
+        decode_ (decode), window_ (2 * nthread)
+  {
+    for (size_t start = 0; const auto &block : blocks_)
+      {
+        starts_.push_back (start);
+        start += block.uncompressed_size;
+      }
+    starts_.push_back (starts_.back () + blocks_.back ().uncompressed_size);
+
+    for (unsigned i = 0; i < nthread; ++i)
+      workers_.emplace_back ([this] { work (); });
+  }
+
+  ~parallel_decompressor ()
+  {
+    {
+      auto lock = std::lock_guard{ mutex_ };
+      stop_ = true;
+    }
+    cv_.notify_all ();
+    for (auto &worker : workers_)
+      worker.join ();
+  }
+
+  size_t
+  read (char *buf, size_t n) override
+  {
+    size_t nread = 0;
+    while (nread < n && next_read_ < blocks_.size ())
+      {
+        auto &slot = window_[next_read_ % window_.size ()];
+        {
+          auto lock = std::unique_lock{ mutex_ };
+          cv_.wait (lock, [&] { return slot.ready; });
+        }
+
+        if (!slot.good)
+          {
+            std::cerr << std::endl
+                      << "*** CORRUPTED TRACE FILE: " << path_ << " ***"
+                      << std::endl;
+            assert (0);
+          }
+
+        auto len = std::min (n - nread, slot.data.size () - read_pos_);
+        memcpy (buf + nread, slot.data.data () + read_pos_, len);
+        nread += len;
+        read_pos_ += len;
+
+        if (read_pos_ == slot.data.size ())
+          {
+            {
+              auto lock = std::lock_guard{ mutex_ };
+              slot.ready = false;
+              ++next_read_;
+            }
+            read_pos_ = 0;
+            cv_.notify_all ();
+          }
+      }
+
+    return nread;
+  }
+
+  size_t
+  skip (size_t n) override
+  {
+    auto lock = std::unique_lock{ mutex_ };
+    cv_.wait (lock, [this] { return !in_flight_; });
+
+    auto pos = std::min (starts_[next_read_] + read_pos_, starts_.back ());
+    auto target = std::min (pos + n, starts_.back ());
+
+    /* Restart the workers from the block TARGET lands in */
+    auto block = std::upper_bound (starts_.begin (), starts_.end (), target)
+                 - starts_.begin () - 1;
+    next_job_ = next_read_ = block;
+    read_pos_ = target - starts_[block];
+    for (auto &slot : window_)
+      slot.ready = false;
+
+    lock.unlock ();
+    cv_.notify_all ();
+
+    return target - pos;
+  }
+
+private:
+  struct slot
+  {
+    std::vector<uint8_t> data;
+    bool good;
+    bool ready = false;
+  };
+
+  void
+  work ()
+  {
+    for (;;)
+      {
+        auto lock = std::unique_lock{ mutex_ };
+        cv_.wait (lock, [this] {
+          return stop_
+                 || (next_job_ < blocks_.size ()
+                     && next_job_ < next_read_ + window_.size ());
+        });
+        if (stop_)
+          return;
+
+        auto i = next_job_++;
+        ++in_flight_;
+        lock.unlock ();
+
+        const auto &block = blocks_[i];
+        auto &slot = window_[i % window_.size ()];
+        slot.data.resize (block.uncompressed_size);
+        slot.good = decode_ (block, file_->data ().data () + block.offset,
+                             slot.data.data ());
+
+        lock.lock ();
+        slot.ready = true;
+        --in_flight_;
+        lock.unlock ();
+        cv_.notify_all ();
+      }
+  }
+
+  std::string path_;
+  std::unique_ptr<mapped_file> file_;
+  std::vector<compressed_block> blocks_;
+  std::vector<size_t> starts_;
+  block_decode_function decode_;
+
+  std::vector<slot> window_;
+  size_t next_job_ = 0, next_read_ = 0, read_pos_ = 0, in_flight_ = 0;
+  bool stop_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::thread> workers_;
+};
+
+#ifdef HAVE_LZMA
+static std::vector<compressed_block>
+xz_blocks (std::span<const uint8_t> file)
+{
+  auto blocks = std::vector<compressed_block>{};
+
+  lzma_index *index = NULL;
+  auto strm = lzma_stream LZMA_STREAM_INIT;
+  if (lzma_file_info_decoder (&strm, &index, UINT64_MAX, file.size ())
+      != LZMA_OK)
+    return blocks;
+
+  strm.next_in = file.data ();
+  strm.avail_in = file.size ();
+  for (;;)
+    {
+      auto ret = lzma_code (&strm, LZMA_RUN);
+      if (ret == LZMA_SEEK_NEEDED)
+        {
+          strm.next_in = file.data () + strm.seek_pos;
+          strm.avail_in = file.size () - strm.seek_pos;
+        }
+      else if (ret == LZMA_STREAM_END)
+        break;
+      else
+        {
+          lzma_end (&strm);
+          return blocks;
+        }
+    }
+  lzma_end (&strm);
+
+  lzma_index_iter iter;
+  lzma_index_iter_init (&iter, index);
+  while (!lzma_index_iter_next (&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK))
+    {
+      blocks.push_back (compressed_block{
+          .offset = iter.block.compressed_file_offset,
+          .size = iter.block.total_size,
+          .uncompressed_size = iter.block.uncompressed_size,
+          .tag = iter.block.unpadded_size << 4 | iter.stream.flags->check });
+    }
+  lzma_index_end (index, NULL);
+
+  return blocks;
+}
+
+static bool
+xz_decode_block (const compressed_block &blk, const uint8_t *in,
+                 uint8_t *out)
+{
+  lzma_filter filters[LZMA_FILTERS_MAX + 1];
+  auto block = lzma_block{};
+  block.version = 1;
+  block.check = lzma_check (blk.tag & 0xf);
+  block.filters = filters;
+  block.header_size = lzma_block_header_size_decode (in[0]);
+
+  if (lzma_block_header_decode (&block, NULL, in) != LZMA_OK)
+    return false;
+
+  auto good = lzma_block_compressed_size (&block, blk.tag >> 4) == LZMA_OK;
+  if (good)
+    {
+      size_t in_pos = block.header_size, out_pos = 0;
+      good = lzma_block_buffer_decode (&block, NULL, in, &in_pos, blk.size,
+                                       out, &out_pos, blk.uncompressed_size)
+                 == LZMA_OK
+             && out_pos == blk.uncompressed_size;
+    }
+
+  for (auto filter = filters; filter->id != LZMA_VLI_UNKNOWN; ++filter)
+    free (filter->options);
+
+  return good;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static uint32_t
+read_le32 (const uint8_t *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+ * Frames listed by the seek table of the zstd seekable format, see
+ * contrib/seekable_format/zstd_seekable_compression_format.md
+ */
+static std::vector<compressed_block>
+zstd_seekable_blocks (std::span<const uint8_t> file)
+{
+  constexpr uint32_t SEEKABLE_MAGIC = 0x8F92EAB1;
+  constexpr size_t FOOTER_SIZE = 9, SKIPPABLE_HEADER_SIZE = 8;
+
+  auto blocks = std::vector<compressed_block>{};
+  if (file.size () < FOOTER_SIZE + SKIPPABLE_HEADER_SIZE)
+    return blocks;
+
+  auto footer = file.data () + file.size () - FOOTER_SIZE;
+  if (read_le32 (footer + 5) != SEEKABLE_MAGIC)
+    return blocks;
+
+  auto nframe = size_t{ read_le32 (footer) };
+  auto entry_size = footer[4] & 0x80 ? 12 : 8;
+  auto table_size = nframe * entry_size;
+  if (table_size + FOOTER_SIZE + SKIPPABLE_HEADER_SIZE > file.size ())
+    return blocks;
+
+  /* The frames must exactly fill what precedes the seek table frame */
+  auto frames_end = file.size () - table_size - FOOTER_SIZE
+                    - SKIPPABLE_HEADER_SIZE;
+  auto entry = footer - table_size;
+  auto offset = size_t{ 0 };
+  for (size_t i = 0; i < nframe; ++i, entry += entry_size)
+    {
+      auto size = read_le32 (entry), uncompressed_size = read_le32 (entry + 4);
+      if (size > frames_end - offset)
+        return {};
+      if (uncompressed_size)
+        blocks.push_back ({ offset, size, uncompressed_size, 0 });
+      offset += size;
+    }
+
+  if (offset != frames_end)
+    return {};
+
+  return blocks;
+}
+
+/* Frames found by walking the frame headers */
+static std::vector<compressed_block>
+zstd_frame_blocks (std::span<const uint8_t> file)
+{
+  auto blocks = std::vector<compressed_block>{};
+  for (size_t offset = 0; offset < file.size ();)
+    {
+      auto in = file.subspan (offset);
+      auto size = ZSTD_findFrameCompressedSize (in.data (), in.size ());
+      if (ZSTD_isError (size))
+        return {};
+
+      auto skippable = (read_le32 (in.data ()) & 0xFFFFFFF0) == 0x184D2A50;
+      if (!skippable)
+        {
+          auto uncompressed_size = ZSTD_getFrameContentSize (in.data (), size);
+          if (uncompressed_size == ZSTD_CONTENTSIZE_UNKNOWN
+              || uncompressed_size == ZSTD_CONTENTSIZE_ERROR)
+            return {};
+          if (uncompressed_size)
+            blocks.push_back ({ offset, size, uncompressed_size, 0 });
+        }
+
+      offset += size;
+    }
+
+  return blocks;
+}
+
+static std::vector<compressed_block>
+zstd_blocks (std::span<const uint8_t> file)
+{
+  auto blocks = zstd_seekable_blocks (file);
+  return blocks.empty () ? zstd_frame_blocks (file) : blocks;
+}
+
+static bool
+zstd_decode_block (const compressed_block &block, const uint8_t *in,
+                   uint8_t *out)
+{
+  return ZSTD_decompress (out, block.uncompressed_size, in, block.size)
+         == block.uncompressed_size;
+}
+#endif
+
+std::unique_ptr<decompressor>
+open_parallel_decompressor (const std::string &path, compression c,
+                            unsigned nthread)
+{
+  auto file = std::make_unique<mapped_file> (path);
+  if (!nthread || !file->good ())
+    return nullptr;
+
+  auto blocks = std::vector<compressed_block>{};
+  block_decode_function decode = nullptr;
+  switch (c)
+    {
+#ifdef HAVE_LZMA
+    case compression::XZ:
+      blocks = xz_blocks (file->data ());
+      decode = xz_decode_block;
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case compression::ZSTD:
+      blocks = zstd_blocks (file->data ());
+      decode = zstd_decode_block;
+      break;
+#endif
+    default:
+      break;
+    }
+
+  if (blocks.size () < 2)
+    return nullptr;
+
+  return std::make_unique<parallel_decompressor> (
+      path, std::move (file), std::move (blocks), decode, nthread);
+}
+
+}
@@ -23,93 +23,107 @@
 #include <algorithm>
 #include <bits/ranges_algo.h>
 #include <cstdio>
+#include <iomanip>
+#include <iostream>
 #include <limits>
 #include <numeric>
+#include <optional>
 #include <ranges>
 
 namespace clueless
 {
 
+template <size_t N, size_t NREG>
 void
-propagator::propagate (const instr &ins)
+basic_propagator<N, NREG>::propagate (const instr &ins)
 {
-  switch (ins.op)
-    {
-    case instr::opcode::OP_REG:
-      reg_to_reg (ins);
-      break;
-    case instr::opcode::OP_LOAD:
-      mem_to_reg (ins);
-      break;
-    case instr::opcode::OP_STORE:
-      reg_to_mem (ins);
-      break;
-    case instr::opcode::OP_BRANCH:
-    case instr::opcode::OP_NOP:
-    default:
-      break;
-    }
+  propagate (ins, [this] (const auto &param) {
+    run_secret_exposed_hooks (param);
+  });
 }
 
+template <size_t N, size_t NREG>
 void
-propagator::reg_to_reg (const instr &ins)
+basic_propagator<N, NREG>::reg_to_reg (const instr &ins)
 {
   if (!(ins.src_reg.size () && ins.dst_reg.size ()))
     return;
 
-  for (auto src_reg : ins.src_reg)
+  using namespace std::ranges;
+
+  /* Untainted sources leave nothing to age or propagate */
+  if (none_of (ins.src_reg,
+               [this] (auto reg) { return reg_taint_.tainted (reg); }))
     {
-      for (auto t : reg_taint_[src_reg])
-        {
-          if (!taint_age_table_[src_reg][t]--)
-            {
-              reg_taint_[src_reg].remove (t);
-            }
-        }
+      for_each (ins.dst_reg, [this] (auto reg) { reg_taint_.clear (reg); });
+      ++stats_.nclean;
+      return;
     }
+  for_each (ins.src_reg, [this] (auto reg) { reg_taint_.read (reg); });
 
   /* Union all source registers' taint sets */
   auto ts = union_reg_taint_sets (ins.src_reg);
 
-  for (auto dst_reg : ins.dst_reg)
+  /*
+   * Work out the new state of every taint in each destination register
+   * as if the states were written in place one source at a time: a
+   * source that is also an earlier destination, or the destination
+   * itself once written, reads back what was written for it.
+   */
+  for (size_t i = 0; i < ins.dst_reg.size (); ++i)
     {
+      auto &states = dst_states_[i];
+      auto &written = dst_written_[i];
+      written = taint_set{};
+
       for (auto src_reg : ins.src_reg)
         {
-          for (auto t : reg_taint_[src_reg])
-            {
-              propagation_level_[dst_reg][t]
-                  = propagation_level_[src_reg][t] + 1;
-              taint_age_table_[dst_reg][t] = taint_age_table_[src_reg][t];
-            }
+          auto alias = std::optional<size_t>{};
+          for (size_t j = 0; j < i; ++j)
+            if (ins.dst_reg[j] == src_reg)
+              alias = j;
+          auto self = ins.dst_reg[i] == src_reg;
+
+          reg_taint_.for_each (src_reg, [&] (auto t, auto state) {
+            if (self && written.test (t))
+              state = states[t];
+            else if (alias)
+              state = dst_states_[*alias][t];
+
+            state.level += state.level < taint_state::MAX_LEVEL;
+            states[t] = state;
+            written.add (t);
+          });
         }
     }
 
-  using namespace std::ranges;
-  for_each (ins.dst_reg, [=, this] (auto reg) { reg_taint_[reg] = ts; });
+  for (size_t i = 0; i < ins.dst_reg.size (); ++i)
+    {
+      reg_taint_.assign (ins.dst_reg[i], ts,
+                         [&] (auto t) { return dst_states_[i][t]; });
+    }
 }
 
+template <size_t N, size_t NREG>
 void
-propagator::mem_to_reg (const instr &ins)
+basic_propagator<N, NREG>::mem_to_reg (const instr &ins)
 {
-  handle_mem_taint (ins);
-
   if (!ins.dst_reg.size ())
     return;
 
   using namespace std::ranges;
 
-  /* Allocate and add new taint to all destination registers' taint sets */
+  /*
+   * Allocate and make new taint the only one in all destination
+   * registers, with propagation depth reset
+   */
   auto t = alloc_taint ();
   for_each (ins.dst_reg, [=, this] (auto reg) {
-    reg_taint_[reg] = taint_set{};
-    reg_taint_[reg].add (t);
-    taint_age_table_[reg][t] = 4096; /* magic: taint fades after 8 reg to reg
-                                     propagation */
-  });
-
-  /* Reset propagation depth */
-  for_each (ins.dst_reg, [=, this] (auto reg) {
-    for_each (propagation_level_[reg], [] (auto &lvl) { lvl = 0; });
+    reg_taint_.assign (reg, t,
+                       taint_state{ .level = 0,
+                                    .age = 4096 }); /* magic: taint fades
+                                                       after 8 reg to reg
+                                                       propagation */
   });
 
   /* Update taint to pointer table */
@@ -117,58 +131,70 @@ propagator::mem_to_reg (const instr &ins)
   taint_ip_[t] = ins.ip;
 }
 
-void
-propagator::reg_to_mem (const instr &ins)
-{
-  handle_mem_taint (ins);
-}
-
-void
-propagator::handle_mem_taint (const instr &ins)
+template <size_t N, size_t NREG>
+bool
+basic_propagator<N, NREG>::collect_exposed_secrets (const instr &ins)
 {
-  if (!ins.mem_reg.size ())
-    return;
-
-  using namespace std::ranges;
-
-  /* Run pointer found hook */
-  auto exposed_secret = std::vector<secret_exposed_hook_param::secret>{};
+  exposed_.clear ();
   for (auto reg : ins.mem_reg)
     {
-      for (auto t : reg_taint_[reg])
-        {
-          exposed_secret.emplace_back (secret_exposed_hook_param::secret{
-              .secret_address = taint_address_[t],
-              .access_ip = taint_ip_[t],
-              .propagation_level = propagation_level_[reg][t] });
-        }
+      reg_taint_.for_each (reg, [&, this] (auto t, auto state) {
+        exposed_.emplace_back (secret_exposed_hook_param::secret{
+            .secret_address = taint_address_[t],
+            .access_ip = taint_ip_[t],
+            .propagation_level = state.level });
+      });
     }
 
-  if (!exposed_secret.size ())
-    return;
-
-  secret_exposed_hook_.run (
-      secret_exposed_hook_param{ .exposed_secret = std::move (exposed_secret),
-                                 .transmit_address = ins.address,
-                                 .transmit_ip = ins.ip });
+  return !exposed_.empty ();
 }
 
-taint_set
-propagator::union_reg_taint_sets (const auto &reg_set) const
+template <size_t N, size_t NREG>
+typename basic_propagator<N, NREG>::taint_set
+basic_propagator<N, NREG>::union_reg_taint_sets (const auto &reg_set) const
 {
-  using namespace std;
-  return transform_reduce (
-      begin (reg_set), end (reg_set), taint_set{},
-      [] (auto lhs, auto rhs) { return lhs | rhs; },
-      [this] (auto reg) { return reg_taint_[reg]; });
+  using reg_set_type = std::remove_cvref_t<decltype (reg_set)>;
+  auto srcs
+      = std::array<const typename taint_set::word_type *,
+                   reg_set_type::capacity ()>{};
+  auto nsrc = size_t{ 0 };
+  for (auto reg : reg_set)
+    srcs[nsrc++] = reg_taint_[reg].data ();
+
+  auto ts = taint_set{};
+  active_taint_kernels.or_reduce (ts.data (), srcs.data (), nsrc,
+                                  taint_set::NWORD);
+  return ts;
 }
 
+template <size_t N, size_t NREG>
 taint
-propagator::alloc_taint ()
+basic_propagator<N, NREG>::alloc_taint ()
 {
   using namespace std::ranges;
   auto t = taint_allocator_.alloc ();
   reg_taint_.remove_all (t);
   return t;
 }
+
+void
+report_propagation_stats (const propagator_types::propagation_stats &stats)
+{
+  std::cerr << "*** Untainted fast path: " << stats.nclean << " of "
+            << stats.ninstr << " instructions";
+  if (stats.ninstr)
+    std::cerr << " (" << std::fixed << std::setprecision (1)
+              << 100.0 * stats.nclean / stats.ninstr << "%)";
+  std::cerr << std::endl;
+}
+
+template class basic_propagator<64, 64>;
+template class basic_propagator<64, 256>;
+template class basic_propagator<256, 64>;
+template class basic_propagator<256, 256>;
+template class basic_propagator<1024, 64>;
+template class basic_propagator<1024, 256>;
+template class basic_propagator<4096, 64>;
+template class basic_propagator<4096, 256>;
+
 }
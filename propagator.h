@@ -22,23 +22,35 @@
 #define PROPAGATOR_H
 
 #include "hook.h"
+#include "reg-list.h"
 #include "taint-allocator.h"
 #include "taint-table.h"
+#include "trace-instruction.h"
 #include <array>
+#include <cstdint>
 #include <functional>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace clueless
 {
 
-class propagator
+/* Types shared by propagators of every capacity */
+struct propagator_types
 {
-public:
   struct instr
   {
-    using reg_set = std::vector<unsigned char>;
+    using reg_set = reg_list<NUM_INSTR_SOURCES>;
+
+    unsigned long long ip;
+    unsigned long long seq;
+    unsigned long long address;
 
-    enum class opcode
+    enum class opcode : unsigned char
     {
       OP_REG,
       OP_LOAD,
@@ -47,16 +59,14 @@ public:
       OP_NOP,
     } op;
 
-    unsigned long long ip;
-    unsigned long long seq;
-
     reg_set src_reg;
     reg_set dst_reg;
     reg_set mem_reg;
-
-    unsigned long long address;
   };
 
+  static_assert (std::is_trivially_copyable_v<instr>
+                 && std::is_standard_layout_v<instr>);
+
   struct secret_exposed_hook_param
   {
     struct secret
@@ -66,43 +76,382 @@ public:
       size_t propagation_level;
     };
 
-    std::vector<secret> exposed_secret;
+    /* Only valid until the handler returns */
+    std::span<const secret> exposed_secret;
     unsigned long long transmit_address, transmit_ip;
   };
 
-  using secret_exposed_hook = hook<secret_exposed_hook_param>;
+  using secret_exposed_hook = hook<const secret_exposed_hook_param &>;
+
+  /*
+   * The secrets exposed by a batch of instructions as structure of
+   * arrays. Event I is the I-th leaking memory instruction, and its
+   * secrets are entries secret_begin (I) to secret_end[I].
+   */
+  struct exposure_batch
+  {
+    /* Per secret */
+    std::vector<unsigned long long> secret_address;
+    std::vector<unsigned long long> access_ip;
+    std::vector<uint8_t> propagation_level;
+
+    /* Per event */
+    std::vector<unsigned long long> transmit_address;
+    std::vector<unsigned long long> transmit_ip;
+    std::vector<unsigned long long> seq;
+    std::vector<size_t> secret_end;
+
+    size_t
+    nevent () const
+    {
+      return seq.size ();
+    }
+
+    size_t
+    secret_begin (size_t event) const
+    {
+      return event ? secret_end[event - 1] : 0;
+    }
+
+    void
+    append (const secret_exposed_hook_param &param, unsigned long long s)
+    {
+      for (const auto &sec : param.exposed_secret)
+        {
+          secret_address.push_back (sec.secret_address);
+          access_ip.push_back (sec.access_ip);
+          propagation_level.push_back (sec.propagation_level);
+        }
+      transmit_address.push_back (param.transmit_address);
+      transmit_ip.push_back (param.transmit_ip);
+      seq.push_back (s);
+      secret_end.push_back (secret_address.size ());
+    }
+
+    void
+    clear ()
+    {
+      secret_address.clear ();
+      access_ip.clear ();
+      propagation_level.clear ();
+      transmit_address.clear ();
+      transmit_ip.clear ();
+      seq.clear ();
+      secret_end.clear ();
+    }
+  };
+
+  /* Instructions per exposure_batch */
+  static constexpr size_t BATCH_SIZE = 4096;
 
+  struct propagation_stats
+  {
+    size_t ninstr = 0;
+    /* Register to register instructions reading no taint */
+    size_t nclean = 0;
+  };
+};
+
+/*
+ * Propagates up to N taints at once through NREG registers. Every
+ * table is sized at compile time, so small capacities stay in cache.
+ */
+template <size_t N = taint::N, size_t NREG = 256>
+class basic_propagator : public propagator_types
+{
+public:
+  basic_propagator () = default;
+
+  /* Take over OTHER, which tracks fewer registers */
+  template <size_t M>
+  explicit basic_propagator (basic_propagator<N, M> &&other)
+      : taint_allocator_ (other.taint_allocator_),
+        reg_taint_ (other.reg_taint_), taint_address_ (other.taint_address_),
+        taint_ip_ (other.taint_ip_),
+        secret_exposed_hook_ (std::move (other.secret_exposed_hook_)),
+        stats_ (other.stats_), batch_ (std::move (other.batch_))
+  {
+  }
+
+  /* Propagate INS, running the secret exposed hooks on what it leaks */
   void propagate (const instr &ins);
 
+  /*
+   * Propagate INS, calling ON_EXPOSED (PARAM) directly on what it
+   * leaks instead of going through the hooks, so that a single
+   * analysis can be inlined into the propagator.
+   */
+  template <typename F> void propagate (const instr &ins, F &&on_exposed);
+
+  /*
+   * Propagate INS, collecting what it leaks into an exposure_batch that
+   * is handed to ON_BATCH (BATCH) every BATCH_SIZE instructions.
+   */
+  template <typename F>
+  void
+  propagate_batched (const instr &ins, F &&on_batch)
+  {
+    propagate (ins, [&, this] (const auto &param) {
+      batch_.append (param, ins.seq);
+    });
+    if (!(stats_.ninstr % BATCH_SIZE))
+      flush_batch (on_batch);
+  }
+
+  /* Hand what propagate_batched has collected so far to ON_BATCH */
+  template <typename F>
+  void
+  flush_batch (F &&on_batch)
+  {
+    if (!batch_.nevent ())
+      return;
+
+    on_batch (std::as_const (batch_));
+    batch_.clear ();
+  }
+
+  const propagation_stats &
+  stats () const
+  {
+    return stats_;
+  }
+
   void
   add_secret_exposed_hook (secret_exposed_hook::function f)
   {
     secret_exposed_hook_.add (f);
   }
 
+  void
+  run_secret_exposed_hooks (const secret_exposed_hook_param &param)
+  {
+    secret_exposed_hook_.run (param);
+  }
+
 private:
+  template <size_t, size_t> friend class basic_propagator;
+
+  using taint_set = clueless::taint_set<N>;
+
   void reg_to_reg (const instr &ins);
   void mem_to_reg (const instr &ins);
-  void reg_to_mem (const instr &ins);
-  void handle_mem_taint (const instr &ins);
+  template <typename F>
+  void handle_mem_taint (const instr &ins, F &on_exposed);
+
+  /* Fill exposed_ with the secrets INS leaks, return whether any */
+  bool collect_exposed_secrets (const instr &ins);
 
   taint_set union_reg_taint_sets (const auto &reg_set) const;
 
   taint alloc_taint ();
 
-  fifo_taint_allocator taint_allocator_;
-  reg_taint_table reg_taint_ = {};
-  taint_address_table taint_address_ = {};
-  taint_address_table taint_ip_ = {};
+  fifo_taint_allocator<N> taint_allocator_;
+  reg_taint_table<N, NREG> reg_taint_ = {};
+  taint_address_table<N> taint_address_ = {};
+  taint_address_table<N> taint_ip_ = {};
   secret_exposed_hook secret_exposed_hook_ = {};
-  using propagation_level_table
-      = std::array<std::array<size_t, taint::N>, reg_taint_table::NREG>;
-  propagation_level_table propagation_level_ = {};
-  using taint_age_table
-      = std::array<std::array<size_t, taint::N>, reg_taint_table::NREG>;
-  taint_age_table taint_age_table_ = {};
+  propagation_stats stats_ = {};
+  std::vector<secret_exposed_hook_param::secret> exposed_;
+  exposure_batch batch_;
+  /* Scratch states of the taints being written to each destination */
+  using taint_state_row = std::array<taint_state, N>;
+  std::array<taint_state_row, instr::reg_set::capacity ()> dst_states_;
+  std::array<taint_set, instr::reg_set::capacity ()> dst_written_;
+};
+
+template <size_t N, size_t NREG>
+template <typename F>
+void
+basic_propagator<N, NREG>::propagate (const instr &ins, F &&on_exposed)
+{
+  ++stats_.ninstr;
+
+  switch (ins.op)
+    {
+    case instr::opcode::OP_REG:
+      reg_to_reg (ins);
+      break;
+    case instr::opcode::OP_LOAD:
+      handle_mem_taint (ins, on_exposed);
+      mem_to_reg (ins);
+      break;
+    case instr::opcode::OP_STORE:
+      handle_mem_taint (ins, on_exposed);
+      break;
+    case instr::opcode::OP_BRANCH:
+    case instr::opcode::OP_NOP:
+    default:
+      break;
+    }
+}
+
+template <size_t N, size_t NREG>
+template <typename F>
+void
+basic_propagator<N, NREG>::handle_mem_taint (const instr &ins, F &on_exposed)
+{
+  if (!ins.mem_reg.size () || !collect_exposed_secrets (ins))
+    return;
+
+  on_exposed (secret_exposed_hook_param{ .exposed_secret = exposed_,
+                                         .transmit_address = ins.address,
+                                         .transmit_ip = ins.ip });
+}
+
+/* Print on stderr how many instructions took the untainted fast path */
+void
+report_propagation_stats (const propagator_types::propagation_stats &stats);
+
+/* Capacities built into propagator.cc */
+inline constexpr auto PROPAGATOR_CAPACITIES
+    = std::array<size_t, 4>{ 64, 256, 1024, 4096 };
+
+extern template class basic_propagator<64, 64>;
+extern template class basic_propagator<64, 256>;
+extern template class basic_propagator<256, 64>;
+extern template class basic_propagator<256, 256>;
+extern template class basic_propagator<1024, 64>;
+extern template class basic_propagator<1024, 256>;
+extern template class basic_propagator<4096, 64>;
+extern template class basic_propagator<4096, 256>;
+
+using propagator = basic_propagator<>;
+
+/*
+ * A propagator over the dense register numbers champsim_trace_decoder
+ * hands out. It only keeps state for the first NREG registers of a
+ * trace, and moves everything over to a propagator for all 256 the
+ * first time an instruction names a higher register.
+ */
+template <size_t N = taint::N>
+class compact_propagator : public propagator_types
+{
+public:
+  static constexpr size_t NREG = 64;
+
+  void
+  propagate (const instr &ins)
+  {
+    propagate (ins, [this] (const auto &param) {
+      if (narrow_)
+        narrow_->run_secret_exposed_hooks (param);
+      else
+        wide_->run_secret_exposed_hooks (param);
+    });
+  }
+
+  template <typename F>
+  void
+  propagate (const instr &ins, F &&on_exposed)
+  {
+    if (narrow_) [[likely]]
+      {
+        if (fits (ins)) [[likely]]
+          {
+            narrow_->propagate (ins, on_exposed);
+            return;
+          }
+
+        widen ();
+      }
+
+    wide_->propagate (ins, on_exposed);
+  }
+
+  template <typename F>
+  void
+  propagate_batched (const instr &ins, F &&on_batch)
+  {
+    if (narrow_) [[likely]]
+      {
+        if (fits (ins)) [[likely]]
+          {
+            narrow_->propagate_batched (ins, on_batch);
+            return;
+          }
+
+        widen ();
+      }
+
+    wide_->propagate_batched (ins, on_batch);
+  }
+
+  template <typename F>
+  void
+  flush_batch (F &&on_batch)
+  {
+    if (narrow_)
+      narrow_->flush_batch (on_batch);
+    else
+      wide_->flush_batch (on_batch);
+  }
+
+  const propagation_stats &
+  stats () const
+  {
+    return narrow_ ? narrow_->stats () : wide_->stats ();
+  }
+
+  void
+  add_secret_exposed_hook (secret_exposed_hook::function f)
+  {
+    if (narrow_)
+      narrow_->add_secret_exposed_hook (f);
+    else
+      wide_->add_secret_exposed_hook (f);
+  }
+
+private:
+  /* Move from narrow_ to wide_ */
+  void
+  widen ()
+  {
+    wide_ = std::make_unique<basic_propagator<N> > (std::move (*narrow_));
+    narrow_.reset ();
+  }
+
+  static bool
+  fits (const instr &ins)
+  {
+    unsigned char regs = 0;
+    for (auto reg_set : { &ins.src_reg, &ins.dst_reg, &ins.mem_reg })
+      for (auto reg : *reg_set)
+        regs |= reg;
+    return regs < NREG;
+  }
+
+  std::unique_ptr<basic_propagator<N, NREG> > narrow_
+      = std::make_unique<basic_propagator<N, NREG> > ();
+  std::unique_ptr<basic_propagator<N> > wide_;
 };
 
+/*
+ * Call F with a fresh compact_propagator for NTAINT taints. Return
+ * false if NTAINT is not one of PROPAGATOR_CAPACITIES.
+ */
+template <typename F>
+bool
+with_propagator (size_t ntaint, F &&f)
+{
+  switch (ntaint)
+    {
+    case 64:
+      f (*std::make_unique<compact_propagator<64> > ());
+      return true;
+    case 256:
+      f (*std::make_unique<compact_propagator<256> > ());
+      return true;
+    case 1024:
+      f (*std::make_unique<compact_propagator<1024> > ());
+      return true;
+    case 4096:
+      f (*std::make_unique<compact_propagator<4096> > ());
+      return true;
+    default:
+      return false;
+    }
+}
+
 }
 
 #endif
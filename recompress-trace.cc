@@ -0,0 +1,300 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decompressor.h"
+#include "trace-instruction.h"
+#include <argp.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+const char *argp_program_version = "recompress-trace 0.1.0";
+const char *argp_program_bug_address = "<xchen@vvvu.org>";
+
+static char doc[]
+    = "Recompress a trace into independent blocks that can be decompressed "
+      "in parallel\v"
+      "The output is a multi-block xz file if OUTPUT ends with .xz, or a "
+      "seekable zstd file if it ends with .zst.";
+
+static char args_doc[] = "TRACE OUTPUT";
+
+const struct argp_option option[]
+    = { { "block-size", 'b', "N", 0,
+          "Put N instructions in each block (default 262144)" },
+        { "level", 'l', "N", 0,
+          "Compression level, 0 to 9 for xz and 0 to the zstd maximum" },
+        { "jobs", 'j', "N", 0, "Compress on N threads" },
+        { 0 } };
+
+struct knobs
+{
+  size_t block_size = 1 << 18;
+  int level = -1;
+  int njob = 1;
+  char *trace_file = nullptr;
+  char *output_file = nullptr;
+};
+
+/* The highest level of the output format, or -1 if it is not supported */
+static int
+max_level (clueless::compression c)
+{
+  switch (c)
+    {
+#ifdef HAVE_LZMA
+    case clueless::compression::XZ:
+      return 9;
+#endif
+#ifdef HAVE_ZSTD
+    case clueless::compression::ZSTD:
+      return ZSTD_maxCLevel ();
+#endif
+    default:
+      return -1;
+    }
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  auto knbs = (knobs *)state->input;
+
+  switch (key)
+    {
+    case 'b':
+      knbs->block_size = atoll (arg);
+      /* Block sizes go in 32-bit fields of the zstd seek table */
+      if (!knbs->block_size
+          || knbs->block_size > UINT32_MAX / sizeof (clueless::input_instr))
+        argp_error (state, "block size must be between 1 and %zu",
+                    UINT32_MAX / sizeof (clueless::input_instr));
+      break;
+
+    case 'l':
+      knbs->level = atoi (arg);
+      break;
+
+    case 'j':
+      knbs->njob = atoi (arg);
+      if (knbs->njob < 1)
+        argp_error (state, "jobs must be at least 1");
+      break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num >= 2)
+        argp_usage (state);
+
+      (state->arg_num ? knbs->output_file : knbs->trace_file) = arg;
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num < 2)
+        argp_usage (state);
+
+      if (auto c = clueless::compression_of (knbs->output_file))
+        {
+          auto max = max_level (*c);
+          if (max < 0)
+            argp_error (state,
+                        "recompress-trace was built without support for %s",
+                        knbs->output_file);
+          if (knbs->level != -1 && (knbs->level < 0 || knbs->level > max))
+            argp_error (state, "level must be between 0 and %d", max);
+        }
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
+static struct argp argp = { option, parse_opt, args_doc, doc };
+
+static void
+write_or_die (const void *buf, size_t n, FILE *file)
+{
+  if (fwrite (buf, 1, n, file) != n)
+    {
+      std::cerr << "*** CANNOT WRITE OUTPUT ***" << std::endl;
+      assert (0);
+    }
+}
+
+#ifdef HAVE_LZMA
+static void
+write_xz (clueless::decompressor &in, FILE *out, const knobs &knbs)
+{
+  auto mt = lzma_mt{};
+  mt.block_size = knbs.block_size * sizeof (clueless::input_instr);
+  mt.threads = knbs.njob;
+  mt.preset = knbs.level < 0 ? LZMA_PRESET_DEFAULT : knbs.level;
+  mt.check = LZMA_CHECK_CRC64;
+
+  auto strm = lzma_stream LZMA_STREAM_INIT;
+  if (lzma_stream_encoder_mt (&strm, &mt) != LZMA_OK)
+    {
+      std::cerr << "*** CANNOT INITIALISE XZ ENCODER ***" << std::endl;
+      assert (0);
+    }
+
+  auto inbuf = std::vector<uint8_t> (1 << 20), outbuf = inbuf;
+  auto action = LZMA_RUN;
+  for (;;)
+    {
+      if (!strm.avail_in && action == LZMA_RUN)
+        {
+          strm.next_in = inbuf.data ();
+          strm.avail_in = in.read ((char *)inbuf.data (), inbuf.size ());
+          if (!strm.avail_in)
+            action = LZMA_FINISH;
+        }
+
+      strm.next_out = outbuf.data ();
+      strm.avail_out = outbuf.size ();
+      auto ret = lzma_code (&strm, action);
+      write_or_die (outbuf.data (), outbuf.size () - strm.avail_out, out);
+
+      if (ret == LZMA_STREAM_END)
+        break;
+      if (ret != LZMA_OK)
+        {
+          std::cerr << "*** XZ ENCODER FAILED ***" << std::endl;
+          assert (0);
+        }
+    }
+
+  lzma_end (&strm);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void
+write_le32 (uint32_t v, FILE *out)
+{
+  uint8_t buf[] = { uint8_t (v), uint8_t (v >> 8), uint8_t (v >> 16),
+                    uint8_t (v >> 24) };
+  write_or_die (buf, sizeof (buf), out);
+}
+
+/*
+ * One frame per block followed by a seek table, see
+ * contrib/seekable_format/zstd_seekable_compression_format.md
+ */
+static void
+write_zstd (clueless::decompressor &in, FILE *out, const knobs &knbs)
+{
+  auto cctx = ZSTD_createCCtx ();
+  ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel,
+                          knbs.level < 0 ? ZSTD_CLEVEL_DEFAULT : knbs.level);
+  ZSTD_CCtx_setParameter (cctx, ZSTD_c_nbWorkers, knbs.njob);
+  ZSTD_CCtx_setParameter (cctx, ZSTD_c_contentSizeFlag, 1);
+
+  auto inbuf
+      = std::vector<char> (knbs.block_size * sizeof (clueless::input_instr));
+  auto outbuf = std::vector<char> (ZSTD_compressBound (inbuf.size ()));
+  auto frames = std::vector<std::pair<uint32_t, uint32_t> >{};
+
+  while (auto n = in.read (inbuf.data (), inbuf.size ()))
+    {
+      auto size = ZSTD_compress2 (cctx, outbuf.data (), outbuf.size (),
+                                  inbuf.data (), n);
+      if (ZSTD_isError (size))
+        {
+          std::cerr << "*** ZSTD ENCODER FAILED ***" << std::endl;
+          assert (0);
+        }
+      write_or_die (outbuf.data (), size, out);
+      frames.emplace_back (size, n);
+    }
+
+  ZSTD_freeCCtx (cctx);
+
+  write_le32 (0x184D2A5E, out);
+  write_le32 (frames.size () * 8 + 9, out);
+  for (auto [size, uncompressed_size] : frames)
+    {
+      write_le32 (size, out);
+      write_le32 (uncompressed_size, out);
+    }
+  write_le32 (frames.size (), out);
+  write_or_die ("\0", 1, out);
+  write_le32 (0x8F92EAB1, out);
+}
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  auto knbs = knobs{};
+
+  argp_parse (&argp, argc, argv, 0, 0, &knbs);
+
+  using namespace clueless;
+
+  auto in_compression = compression_of (knbs.trace_file);
+  auto out_compression = compression_of (knbs.output_file);
+  if (!in_compression || !out_compression)
+    {
+      std::cerr << "Traces must be gz, xz or zst compressed!" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  auto in = open_decompressor (knbs.trace_file, *in_compression, knbs.njob);
+  auto out = fopen (knbs.output_file, "wb");
+  if (!out)
+    {
+      std::cerr << "*** CANNOT OPEN OUTPUT FILE: " << knbs.output_file
+                << " ***" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  switch (*out_compression)
+    {
+#ifdef HAVE_LZMA
+    case compression::XZ:
+      write_xz (*in, out, knbs);
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case compression::ZSTD:
+      write_zstd (*in, out, knbs);
+      break;
+#endif
+    default:
+      /* Rejected by parse_opt */
+      assert (0);
+    }
+
+  fclose (out);
+}
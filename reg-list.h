@@ -0,0 +1,95 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REG_LIST_H
+#define REG_LIST_H
+
+#include <cassert>
+#include <cstddef>
+
+namespace clueless
+{
+
+/*
+ * A list of at most N register ids stored inline. It is a trivially
+ * copyable aggregate, so an instruction holding some can be copied
+ * with memcpy and written to disk as is.
+ */
+template <size_t N> struct reg_list
+{
+  using value_type = unsigned char;
+  using const_iterator = const value_type *;
+
+  static constexpr size_t
+  capacity ()
+  {
+    return N;
+  }
+
+  constexpr size_t
+  size () const
+  {
+    return size_;
+  }
+
+  constexpr bool
+  empty () const
+  {
+    return !size_;
+  }
+
+  constexpr const_iterator
+  begin () const
+  {
+    return regs_;
+  }
+
+  constexpr const_iterator
+  end () const
+  {
+    return regs_ + size_;
+  }
+
+  constexpr value_type
+  operator[] (size_t i) const
+  {
+    return regs_[i];
+  }
+
+  constexpr void
+  push_back (value_type reg)
+  {
+    assert (size_ < N);
+    regs_[size_++] = reg;
+  }
+
+  constexpr void
+  clear ()
+  {
+    size_ = 0;
+  }
+
+  unsigned char size_;
+  value_type regs_[N];
+};
+
+}
+
+#endif
@@ -18,8 +18,12 @@
  * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "async-tracereader.h"
 #include "champsim-trace-decoder.h"
 #include "propagator.h"
+#include "shards.h"
+#include "stack-distance.h"
+#include "trace-cache.h"
 #include "tracereader.h"
 #include <algorithm>
 #include <argp.h>
@@ -31,11 +35,11 @@
 #include <iostream>
 #include <limits>
 #include <numeric>
-#include <set>
 #include <sstream>
 #include <string>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 const char *argp_program_version = "reuse-distance 0.1";
 const char *argp_program_bug_address = "<xiaoyue.chen@it.uu.se>";
@@ -47,15 +51,72 @@ static char args_doc[] = "TRACE";
 const struct argp_option option[]
     = { { "simulate", 's', "N", 0, "Simulate N instructions" },
         { "heartbeat", 'b', "N", 0, "Print heartbeat every N instructions" },
+        { "pipeline", 'p', 0, 0, "Decompress the trace on a separate thread" },
+        { "jobs", 'j', "N", 0, "Decompress blocks of the trace on N threads" },
+        { "taints", 't', "N", 0,
+          "Track N taints at once: 64, 256, 1024 (default) or 4096" },
+        { "distance", 'd', "KIND", 0,
+          "Count accesses (default) or stack, the distinct blocks, between "
+          "two uses of a block" },
+        { "sample-rate", 'r', "R", 0,
+          "Only track blocks whose hash falls in a fraction R of the hash "
+          "space" },
+        { "sample-size", 'k', "N", 0,
+          "Only track up to N blocks, lowering the sampling rate as needed" },
+        { "mrc", 'c', "SIZES", 0,
+          "Print the miss ratios of critical blocks in LRU caches of SIZES "
+          "bytes, e.g. 32K,1M,32M, instead; implies --distance=stack" },
+        { "granularity", 'g', "SHIFTS", 0,
+          "Track blocks of 2^SHIFT bytes for each of SHIFTS, e.g. 6,12,21 "
+          "(default 6)" },
         { 0 } };
 
 struct knobs
 {
   size_t nsimulate = 10000000;
   size_t heartbeat = 100000;
+  bool pipeline = false;
+  unsigned njob = 1;
+  size_t ntaint = clueless::taint::N;
+  bool stack_distance = false;
+  double sample_rate = 1;
+  size_t sample_size = 0;
+  std::vector<size_t> mrc_sizes;
+  std::vector<size_t> block_shifts;
   char *trace_file = nullptr;
 };
 
+/* Parse a comma-separated list of sizes with optional K, M or G */
+static bool
+parse_sizes (const char *arg, std::vector<size_t> &sizes)
+{
+  for (auto p = arg; *p;)
+    {
+      char *end;
+      auto size = strtoull (p, &end, 10);
+      switch (*end)
+        {
+        case 'G':
+          size <<= 10;
+          [[fallthrough]];
+        case 'M':
+          size <<= 10;
+          [[fallthrough]];
+        case 'K':
+          size <<= 10;
+          ++end;
+          break;
+        }
+
+      if (end == p || !size || (*end && *end != ','))
+        return false;
+
+      sizes.push_back (size);
+      p = *end ? end + 1 : end;
+    }
+  return !sizes.empty ();
+}
+
 static error_t
 parse_opt (int key, char *arg, struct argp_state *state)
 {
@@ -71,6 +132,50 @@ parse_opt (int key, char *arg, struct argp_state *state)
       knbs->heartbeat = atoll (arg);
       break;
 
+    case 'p':
+      knbs->pipeline = true;
+      break;
+
+    case 'j':
+      knbs->njob = atoi (arg);
+      break;
+
+    case 't':
+      knbs->ntaint = atoll (arg);
+      if (std::ranges::find (clueless::PROPAGATOR_CAPACITIES, knbs->ntaint)
+          == end (clueless::PROPAGATOR_CAPACITIES))
+        argp_error (state, "unsupported number of taints: %s", arg);
+      break;
+
+    case 'd':
+      if (arg == std::string{ "stack" })
+        knbs->stack_distance = true;
+      else if (arg != std::string{ "access" })
+        argp_error (state, "unknown distance: %s", arg);
+      break;
+
+    case 'r':
+      knbs->sample_rate = atof (arg);
+      if (!(knbs->sample_rate > 0 && knbs->sample_rate <= 1))
+        argp_error (state, "sampling rate out of (0, 1]: %s", arg);
+      break;
+
+    case 'k':
+      knbs->sample_size = atoll (arg);
+      break;
+
+    case 'c':
+      if (!parse_sizes (arg, knbs->mrc_sizes))
+        argp_error (state, "bad cache sizes: %s", arg);
+      knbs->stack_distance = true;
+      break;
+
+    case 'g':
+      if (!parse_sizes (arg, knbs->block_shifts)
+          || std::ranges::max (knbs->block_shifts) >= 64)
+        argp_error (state, "bad granularities: %s", arg);
+      break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num >= 1)
         argp_usage (state);
@@ -81,6 +186,8 @@ parse_opt (int key, char *arg, struct argp_state *state)
     case ARGP_KEY_END:
       if (state->arg_num < 1)
         argp_usage (state);
+      if (knbs->block_shifts.empty ())
+        knbs->block_shifts.push_back (6);
       break;
 
     default:
@@ -91,24 +198,164 @@ parse_opt (int key, char *arg, struct argp_state *state)
 
 static struct argp argp = { option, parse_opt, args_doc, doc };
 
+/*
+ * IP sets that outgrew the inline slots of their sampler, each a sorted
+ * vector of its own so that a released set hands its memory straight
+ * back to the allocator, and looked up by index from the sampler
+ */
+class spilled_ip_sets
+{
+public:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max ();
+
+  uint32_t
+  alloc ()
+  {
+    if (free_.empty ())
+      {
+        sets_.emplace_back ();
+        return sets_.size () - 1;
+      }
+
+    auto set = free_.back ();
+    free_.pop_back ();
+    return set;
+  }
+
+  void
+  release (uint32_t set)
+  {
+    if (set == NONE)
+      return;
+
+    sets_[set] = {};
+    free_.push_back (set);
+  }
+
+  /* Insert IP into SET. Return whether it was not there before. */
+  bool
+  insert (uint32_t set, unsigned long long ip)
+  {
+    auto &ips = sets_[set];
+    auto it = std::ranges::lower_bound (ips, ip);
+    if (it != ips.end () && *it == ip)
+      return false;
+
+    ips.insert (it, ip);
+    return true;
+  }
+
+private:
+  std::vector<std::vector<unsigned long long> > sets_;
+  std::vector<uint32_t> free_;
+};
+
 struct reuse_distance_sampler
 {
   explicit reuse_distance_sampler (size_t timestamp, unsigned long long ip)
-      : timestamp (timestamp), naccess (1)
+      : timestamp (timestamp), naccess (1), nip (1), ip_set{ ip }
   {
     using namespace std::ranges;
     fill (distance_set, std::numeric_limits<size_t>::max ());
-    ip_set.emplace (ip);
+  }
+
+  /* Keep DIST if it is below the largest distance kept */
+  void
+  record_distance (size_t dist)
+  {
+    if (dist < distance_set[max_slot])
+      {
+        distance_set[max_slot] = dist;
+        max_slot = std::ranges::max_element (distance_set)
+                   - distance_set.begin ();
+      }
+  }
+
+  /* Add IP to the IPs seen, spilling to SETS past NINLINE of them */
+  void
+  add_ip (unsigned long long ip, spilled_ip_sets &sets)
+  {
+    auto inline_end = ip_set.begin () + std::min<size_t> (nip, NINLINE);
+    if (std::find (ip_set.begin (), inline_end, ip) != inline_end)
+      return;
+
+    if (nip < NINLINE)
+      {
+        ip_set[nip++] = ip;
+        return;
+      }
+
+    if (spill == spilled_ip_sets::NONE)
+      spill = sets.alloc ();
+    nip += sets.insert (spill, ip);
   }
 
   static constexpr size_t NSAMPLE = 10;
+  static constexpr size_t NINLINE = 3;
 
   std::array<size_t, NSAMPLE> distance_set;
   size_t timestamp;
   size_t naccess;
-  std::set<unsigned long long> ip_set;
+  uint32_t nip;
+  /* The spilled set holding the IPs after the first NINLINE */
+  uint32_t spill = spilled_ip_sets::NONE;
+  uint8_t max_slot = 0;
+  std::array<unsigned long long, NINLINE> ip_set;
 };
 
+/*
+ * Accesses to critical blocks binned by LRU stack distance at the
+ * capacities, in blocks, of the caches of interest. An access hits in
+ * a cache holding more blocks than its distance.
+ */
+struct miss_ratio_curve
+{
+  miss_ratio_curve (std::vector<size_t> sizes, unsigned block_shift)
+      : size (std::move (sizes)), histogram (size.size () + 1)
+  {
+    using namespace std::ranges;
+    sort (size);
+    transform (size, back_inserter (capacity),
+               [=] (auto bytes) { return bytes >> block_shift; });
+  }
+
+  /* Record an access at distance DIST that stands for WEIGHT accesses */
+  void
+  record (size_t dist, double weight)
+  {
+    histogram[std::ranges::upper_bound (capacity, dist) - capacity.begin ()]
+        += weight;
+    naccess += weight;
+  }
+
+  /* Cache sizes in bytes, ascending */
+  std::vector<size_t> size;
+  std::vector<size_t> capacity;
+  /* Bin I holds the accesses that hit from capacity[I] on */
+  std::vector<double> histogram;
+  double naccess = 0;
+};
+
+/* Print MRC one size a line, each line starting with PREFIX */
+void
+print_miss_ratio_curve (std::ostream &os, const miss_ratio_curve &mrc,
+                        const std::string &prefix)
+{
+  /* Cache I misses the accesses in the bins after bin I */
+  auto nmiss = std::vector<double> (mrc.size.size ());
+  auto nfar = 0.0;
+  for (auto i = mrc.size.size (); i--;)
+    {
+      nfar += mrc.histogram[i + 1];
+      nmiss[i] = nfar;
+    }
+
+  for (size_t i = 0; i < mrc.size.size (); ++i)
+    os << prefix << mrc.size[i] << " " << std::llround (mrc.naccess) << " "
+       << std::llround (nmiss[i]) << " "
+       << (mrc.naccess ? nmiss[i] / mrc.naccess : 0) << std::endl;
+}
+
 std::ostream &
 operator<< (std::ostream &os, const reuse_distance_sampler &sampler)
 {
@@ -128,7 +375,7 @@ operator<< (std::ostream &os, const reuse_distance_sampler &sampler)
   auto sd = sqrt (variance);
   using namespace std::ranges;
   os << mean << " " << min (distance_set) << " " << max (distance_set) << " "
-     << sd << " " << sampler.ip_set.size () << " " << sampler.naccess;
+     << sd << " " << sampler.nip << " " << sampler.naccess;
   return os;
 }
 
@@ -140,6 +387,30 @@ operator<< (std::ostream &os,
   return os;
 }
 
+/* What is tracked of blocks of one size */
+struct granularity
+{
+  granularity (unsigned shift, const knobs &knbs)
+      : shift (shift), spatial (knbs.sample_rate, knbs.sample_size),
+        mrc (knbs.mrc_sizes, shift)
+  {
+  }
+
+  unsigned long long
+  block_address_of (unsigned long long addr) const
+  {
+    return addr >> shift;
+  }
+
+  unsigned shift;
+  std::unordered_map<unsigned long long, reuse_distance_sampler>
+      reuse_distance;
+  spilled_ip_sets spilled_ips;
+  clueless::stack_distance lru_stack;
+  clueless::shards spatial;
+  miss_ratio_curve mrc;
+};
+
 int
 main (int argc, char *argv[])
 {
@@ -148,70 +419,154 @@ main (int argc, char *argv[])
   argp_parse (&argp, argc, argv, 0, 0, &knbs);
 
   using namespace clueless;
-  auto reader = tracereader{ knbs.trace_file };
-  auto decoder = champsim_trace_decoder{};
-  auto pp = propagator{};
-
   using namespace std::ranges;
 
-  auto reuse_distance
-      = std::unordered_map<unsigned long long, reuse_distance_sampler>{};
+  auto granularities = std::vector<granularity>{};
+  for (auto shift : knbs.block_shifts)
+    granularities.emplace_back (shift, knbs);
 
   size_t reuse_distance_clk = 0;
 
-  constexpr auto block_address_of
-      = [] (auto addr) constexpr { return addr >> 6; };
+  /* Drop blocks from the sample once a fixed-size sample overflows */
+  auto shrink_sample = [&] (auto &g) {
+    auto nsampled = knbs.stack_distance ? g.lru_stack.nblock ()
+                                        : g.reuse_distance.size ();
+    if (!g.spatial.full (nsampled))
+      return;
+
+    auto blocks = std::vector<unsigned long long>{};
+    blocks.reserve (nsampled);
+    if (knbs.stack_distance)
+      g.lru_stack.for_each_block (
+          [&] (auto blk) { blocks.push_back (blk); });
+    else
+      for (const auto &[blk, sampler] : g.reuse_distance)
+        blocks.push_back (blk);
+    g.spatial.shrink (blocks);
+
+    auto sampled = [&] (auto blk) { return g.spatial.sampled (blk); };
+    std::erase_if (g.reuse_distance, [&] (const auto &pair) {
+      if (sampled (pair.first))
+        return false;
+      g.spilled_ips.release (pair.second.spill);
+      return true;
+    });
+    g.lru_stack.retain (sampled);
+  };
 
-  auto init_address_reuse_distance = [&] (auto param) {
+  auto init_address_reuse_distance = [&] (const auto &param) {
     auto &&[exposed_secret, transmit_addr, transmit_ip] = param;
-    for (auto &sec : exposed_secret)
+    for (auto &g : granularities)
       {
-        auto [secret_addr, access_ip, propagation_level] = sec;
-        reuse_distance.emplace (std::make_pair (
-            block_address_of (secret_addr),
-            reuse_distance_sampler{ reuse_distance_clk, access_ip }));
+        for (auto &sec : exposed_secret)
+          {
+            auto [secret_addr, access_ip, propagation_level] = sec;
+            auto block_addr = g.block_address_of (secret_addr);
+            if (!g.spatial.sampled (block_addr))
+              continue;
+
+            g.reuse_distance.emplace (std::make_pair (
+                block_addr,
+                reuse_distance_sampler{ reuse_distance_clk, access_ip }));
+          }
+        shrink_sample (g);
       }
   };
 
-  pp.add_secret_exposed_hook (init_address_reuse_distance);
+  auto record_access = [&] (auto &g, const auto &ins) {
+    auto block_addr = g.block_address_of (ins.address);
+    if (!g.spatial.sampled (block_addr))
+      return;
 
-  for_each (
-      views::iota (size_t{ 0 }) | views::take (knbs.nsimulate), [&] (auto) {
-        auto input_ins = reader.read_single_instr ();
-        const auto &decoded_ins = decoder.decode (input_ins);
-        pp.propagate (decoded_ins);
+    auto lru_dist = knbs.stack_distance ? g.lru_stack.access (block_addr)
+                                        : stack_distance::COLD;
+    if (lru_dist != stack_distance::COLD)
+      lru_dist *= g.spatial.scale ();
 
-        if (decoded_ins.op == propagator::instr::opcode::OP_LOAD
-            || decoded_ins.op == propagator::instr::opcode::OP_STORE)
-          {
-            ++reuse_distance_clk;
+    if (auto it = g.reuse_distance.find (block_addr);
+        it != g.reuse_distance.end ())
+      {
+        auto &sampler = it->second;
+        sampler.add_ip (ins.ip, g.spilled_ips);
+        sampler.record_distance (
+            knbs.stack_distance ? lru_dist
+                                : reuse_distance_clk - sampler.timestamp - 1);
+        sampler.timestamp = reuse_distance_clk;
+        ++sampler.naccess;
+        g.mrc.record (lru_dist, g.spatial.scale ());
+      }
 
-            if (auto it
-                = reuse_distance.find (block_address_of (decoded_ins.address));
-                it != reuse_distance.end ())
+    shrink_sample (g);
+  };
+
+  auto run = [&] (auto &pp) {
+    auto simulate = [&] (auto &reader, auto &decoder) {
+      for (auto i = size_t{ 0 }; i < knbs.nsimulate;)
+        {
+          auto block = reader.next_block ();
+          block = block.first (std::min (block.size (), knbs.nsimulate - i));
+          i += block.size ();
+
+          for_each (block, [&] (const auto &input_ins) {
+            const auto &decoded_ins = decoder.decode (input_ins);
+            pp.propagate (decoded_ins, init_address_reuse_distance);
+
+            if (decoded_ins.op == propagator::instr::opcode::OP_LOAD
+                || decoded_ins.op == propagator::instr::opcode::OP_STORE)
               {
-                auto &sampler = it->second;
-                sampler.ip_set.emplace (decoded_ins.ip);
-                auto max_dist_it = max_element (sampler.distance_set);
-                auto dist = reuse_distance_clk - sampler.timestamp - 1;
-                if (dist < *max_dist_it)
-                  {
-                    *max_dist_it = dist;
-                  }
-                sampler.timestamp = reuse_distance_clk;
-                ++sampler.naccess;
+                ++reuse_distance_clk;
+                for (auto &g : granularities)
+                  record_access (g, decoded_ins);
               }
-          }
-      });
+          });
+        }
+    };
+
+    if (trace_cache_reader::is_trace_cache (knbs.trace_file))
+      {
+        auto reader = trace_cache_reader{ knbs.trace_file };
+        auto decoder = trace_cache_decoder{};
+        simulate (reader, decoder);
+      }
+    else if (knbs.pipeline)
+      {
+        auto reader = async_tracereader{ knbs.trace_file, knbs.njob };
+        auto decoder = champsim_trace_decoder{};
+        simulate (reader, decoder);
+      }
+    else
+      {
+        auto reader = tracereader{ knbs.trace_file, knbs.njob };
+        auto decoder = champsim_trace_decoder{};
+        simulate (reader, decoder);
+      }
+
+    report_propagation_stats (pp.stats ());
+  };
+
+  with_propagator (knbs.ntaint, run);
+
+  /* Tell granularities apart by a leading column if there are several */
+  auto prefix_of = [&] (const auto &g) {
+    return granularities.size () > 1 ? std::to_string (g.shift) + " " : "";
+  };
+  auto shift_column = granularities.size () > 1 ? "shift " : "";
+
+  if (!knbs.mrc_sizes.empty ())
+    {
+      std::cout << shift_column << "size accesses misses ratio" << std::endl;
+      std::cout << std::fixed << std::setprecision (4);
+      for (const auto &g : granularities)
+        print_miss_ratio_curve (std::cout, g.mrc, prefix_of (g));
+      return 0;
+    }
 
-  std::cout << "address mean min max sd nip naccess" << std::endl;
+  std::cout << shift_column << "address mean min max sd nip naccess"
+            << std::endl;
   std::cout << std::fixed << std::setprecision (2);
-  auto cout_it = std::ostream_iterator<
-      std::pair<void *, const reuse_distance_sampler &> > (std::cout, "\n");
-
-  copy (reuse_distance | views::transform ([] (const auto &pair) {
-          const auto &[address, sampler] = pair;
-          return std::make_pair ((void *)address, std::cref (sampler));
-        }),
-        cout_it);
+  for (const auto &g : granularities)
+    for (const auto &[address, sampler] : g.reuse_distance)
+      std::cout << prefix_of (g)
+                << std::make_pair ((void *)address, std::cref (sampler))
+                << "\n";
 }
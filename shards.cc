@@ -18,19 +18,34 @@
  * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "taint-allocator.h"
+#include "shards.h"
 
 #include <algorithm>
+#include <cmath>
 
 namespace clueless
 {
 
-taint
-fifo_taint_allocator::alloc ()
+shards::shards (double rate, size_t size)
+    : threshold_ (std::clamp<uint64_t> (std::llround (rate * P), 1, P)),
+      size_ (size)
 {
-  auto t0 = t_;
-  t_ = taint{ (t_ + 1) % taint::N };
-  return t0;
+}
+
+void
+shards::shrink (const std::vector<unsigned long long> &blocks)
+{
+  auto keep = size_ - size_ / 8;
+  if (blocks.size () <= keep)
+    return;
+
+  auto residue = std::vector<uint64_t> (blocks.size ());
+  std::ranges::transform (blocks, residue.begin (),
+                          [] (auto block) { return hash (block) % P; });
+
+  /* Everything from the first dropped residue up goes */
+  std::ranges::nth_element (residue, residue.begin () + keep);
+  threshold_ = std::max<uint64_t> (residue[keep], 1);
 }
 
 }
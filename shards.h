@@ -0,0 +1,94 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace clueless
+{
+
+/*
+ * Spatial sampling of blocks after SHARDS (Waldspurger et al., FAST
+ * '15). A block is sampled when its hash modulo P falls under a
+ * threshold T, so every access to it is either sampled or not, and
+ * the sampled blocks make up about R = T / P of all blocks. Distances
+ * counted in sampled blocks are scaled by 1 / R.
+ *
+ * With a fixed rate, T never changes. With a fixed size, T starts at
+ * R * P and comes down whenever more than SIZE blocks are sampled,
+ * dropping the blocks with the largest hashes.
+ */
+class shards
+{
+public:
+  static constexpr uint64_t P = 1 << 24;
+
+  /* Sample at RATE, and no more than SIZE blocks unless SIZE is 0 */
+  explicit shards (double rate = 1, size_t size = 0);
+
+  bool
+  sampled (unsigned long long block) const
+  {
+    return hash (block) % P < threshold_;
+  }
+
+  /* 1 / R, the number of blocks each sampled block stands for */
+  double
+  scale () const
+  {
+    return double (P) / threshold_;
+  }
+
+  /* Whether NBLOCK sampled blocks are too many for a fixed size */
+  bool
+  full (size_t nblock) const
+  {
+    return size_ && nblock > size_;
+  }
+
+  /*
+   * Lower the threshold until at most 7/8 of the size of BLOCKS, the
+   * blocks sampled so far, stay sampled. Shrinking by more than one
+   * block at a time keeps the cost of dropping the others amortised.
+   */
+  void shrink (const std::vector<unsigned long long> &blocks);
+
+  static uint64_t
+  hash (unsigned long long block)
+  {
+    /* The splitmix64 finaliser */
+    uint64_t z = block + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+private:
+  uint64_t threshold_;
+  size_t size_;
+};
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace clueless
+{
+
+/*
+ * Lock-free ring shared by exactly one producer and one consumer
+ * thread. Slots are filled and drained in place: the producer writes
+ * into back () and publishes it with push (), the consumer reads
+ * front () and hands it back with pop (). Both sides sleep on the
+ * other side's index instead of spinning when the ring is full or
+ * empty.
+ */
+template <typename T, size_t N> class spsc_ring
+{
+  static_assert (N && !(N & (N - 1)), "capacity must be a power of two");
+
+public:
+  /* Producer: wait for a free slot */
+  T &
+  back ()
+  {
+    auto tail = tail_.load (std::memory_order_relaxed);
+    for (auto head = head_.load (std::memory_order_acquire); tail - head == N;
+         head = head_.load (std::memory_order_acquire))
+      {
+        head_.wait (head, std::memory_order_acquire);
+      }
+    return slots_[tail % N];
+  }
+
+  /* Producer: publish the slot returned by back () */
+  void
+  push ()
+  {
+    tail_.fetch_add (1, std::memory_order_release);
+    tail_.notify_one ();
+  }
+
+  /* Consumer: wait for a published slot */
+  T &
+  front ()
+  {
+    auto head = head_.load (std::memory_order_relaxed);
+    for (auto tail = tail_.load (std::memory_order_acquire); tail == head;
+         tail = tail_.load (std::memory_order_acquire))
+      {
+        tail_.wait (tail, std::memory_order_acquire);
+      }
+    return slots_[head % N];
+  }
+
+  /* Consumer: release the slot returned by front () */
+  void
+  pop ()
+  {
+    head_.fetch_add (1, std::memory_order_release);
+    head_.notify_one ();
+  }
+
+  bool
+  empty () const
+  {
+    return head_.load (std::memory_order_acquire)
+           == tail_.load (std::memory_order_acquire);
+  }
+
+private:
+  std::array<T, N> slots_ = {};
+  alignas (64) std::atomic<size_t> head_ = 0;
+  alignas (64) std::atomic<size_t> tail_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stack-distance.h"
+
+#include <algorithm>
+
+namespace clueless
+{
+
+static constexpr size_t MIN_STAMPS = 1 << 16;
+
+stack_distance::stack_distance () : tree_ (MIN_STAMPS + 1) {}
+
+size_t
+stack_distance::access (unsigned long long block)
+{
+  if (now_ + 1 == tree_.size ())
+    compact ();
+
+  auto [last, inserted] = last_access_.try_emplace (block, now_);
+  auto dist = COLD;
+  if (!inserted)
+    {
+      /* Every other block was last accessed before now */
+      dist = nblock () - count_before (last + 1);
+      add (last, -1);
+      last = now_;
+    }
+
+  add (now_++, 1);
+  return dist;
+}
+
+void
+stack_distance::add (size_t time, long delta)
+{
+  for (auto i = time + 1; i < tree_.size (); i += i & -i)
+    tree_[i] += delta;
+}
+
+size_t
+stack_distance::count_before (size_t time) const
+{
+  size_t n = 0;
+  for (auto i = time; i; i -= i & -i)
+    n += tree_[i];
+  return n;
+}
+
+void
+stack_distance::compact ()
+{
+  /* A block's new stamp is the number of live stamps before its old one */
+  last_access_.for_each ([this] (auto, auto &time) {
+    time = count_before (time);
+  });
+
+  now_ = nblock ();
+  tree_.assign (std::max (MIN_STAMPS, 2 * now_) + 1, 0);
+
+  /* Stamps 0 to now_ - 1 are live: node I covers (I - lowbit (I), I] */
+  for (size_t i = 1; i < tree_.size (); ++i)
+    tree_[i] = std::min (i, now_) - std::min (i - (i & -i), now_);
+}
+
+}
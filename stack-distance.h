@@ -0,0 +1,106 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include "address-set.h"
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace clueless
+{
+
+/*
+ * LRU stack distances of a stream of block accesses. Each block is
+ * stamped with the time of its last access, and a Fenwick tree over
+ * time counts the blocks last accessed in any interval, so an access
+ * costs O(log n). When time runs past the end of the tree, the live
+ * stamps are renumbered 0, 1, ... in order, which keeps the tree at
+ * most about twice the number of distinct blocks.
+ */
+class stack_distance
+{
+public:
+  /* The distance of a block's first access */
+  static constexpr size_t COLD = std::numeric_limits<size_t>::max ();
+
+  stack_distance ();
+
+  /*
+   * Access BLOCK. Return the number of distinct other blocks accessed
+   * since BLOCK was last accessed, or COLD.
+   */
+  size_t access (unsigned long long block);
+
+  /* Number of distinct blocks accessed so far */
+  size_t
+  nblock () const
+  {
+    return last_access_.size ();
+  }
+
+  /* Call F (BLOCK) for each block accessed so far */
+  template <typename F>
+  void
+  for_each_block (F f) const
+  {
+    last_access_.for_each ([&] (auto block, auto) { f (block); });
+  }
+
+  /* Forget every block but those PRED (BLOCK) holds for */
+  template <typename Pred>
+  void
+  retain (Pred pred)
+  {
+    auto kept = address_map<size_t>{};
+    kept.reserve (nblock ());
+    last_access_.for_each ([&] (auto block, auto time) {
+      if (pred (block))
+        kept.try_emplace (block, time);
+    });
+    last_access_ = std::move (kept);
+
+    std::ranges::fill (tree_, 0);
+    last_access_.for_each ([this] (auto, auto time) { add (time, 1); });
+    compact ();
+  }
+
+private:
+  /* Add DELTA to the count at TIME */
+  void add (size_t time, long delta);
+
+  /* Number of blocks last accessed before TIME */
+  size_t count_before (size_t time) const;
+
+  /* Renumber the live stamps from 0 and make room for as many again */
+  void compact ();
+
+  address_map<size_t> last_access_;
+  /* Fenwick tree, 1-based, over the time of each block's last access */
+  std::vector<size_t> tree_;
+  size_t now_ = 0;
+};
+
+}
+
+#endif
@@ -23,13 +23,21 @@
 
 #include "taint.h"
 
+#include <cstddef>
+
 namespace clueless
 {
 
-class fifo_taint_allocator
+template <size_t N = taint::N> class fifo_taint_allocator
 {
 public:
-  taint alloc ();
+  taint
+  alloc ()
+  {
+    auto t0 = t_;
+    t_ = taint{ (t_ + 1) % N };
+    return t0;
+  }
 
 private:
   taint t_{};
@@ -21,20 +21,29 @@
 #ifndef TAINT_SET_H
 #define TAINT_SET_H
 
+#include "taint-simd.h"
 #include "taint.h"
 
 #include <algorithm>
-#include <bitset>
+#include <array>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
-#include <ranges>
 
 namespace clueless
 {
 
-class taint_set
+/* A set of up to N taints */
+template <size_t N = taint::N> class taint_set
 {
 public:
+  using word_type = uint64_t;
+  static constexpr size_t WORD_BITS = 64;
+  static constexpr size_t NWORD = N / WORD_BITS;
+
+  static_assert (N % WORD_BITS == 0);
+
   class const_iterator
   {
   public:
@@ -71,11 +80,7 @@ public:
     const_iterator &
     operator++ ()
     {
-      using namespace std::ranges;
-      auto range = views::iota (taint_ + 1, taint::N);
-      auto found = find_if (
-          range, [this] (auto i) { return taint_set_->set_.test (i); });
-      taint_ = found == range.end () ? taint (taint::N) : taint (*found);
+      taint_ = taint_set_->find_next (taint_ + 1);
       return *this;
     }
 
@@ -93,63 +98,148 @@ public:
   };
 
   taint_set &
-  operator|= (taint_set other)
+  operator|= (const taint_set &other)
   {
-    set_ |= other.set_;
+    for (size_t i = 0; i < NWORD; ++i)
+      words_[i] |= other.words_[i];
     return *this;
   }
 
   taint_set &
   add (taint t)
   {
-    set_.set (t);
+    words_[t / WORD_BITS] |= bit_of (t);
     return *this;
   }
 
   taint_set &
   remove (taint t)
   {
-    set_.reset (t);
+    words_[t / WORD_BITS] &= ~bit_of (t);
     return *this;
   }
 
   bool
   test (taint t) const
   {
-    return set_.test (t);
+    return words_[t / WORD_BITS] & bit_of (t);
+  }
+
+  bool
+  any () const
+  {
+    return active_taint_kernels.any (words_.data (), NWORD);
   }
 
   bool
   empty () const
   {
-    return !set_.any ();
+    return !any ();
   }
 
-  const_iterator
-  begin () const
+  /* Return the number of taints in the set below T */
+  size_t
+  rank (taint t) const
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < t / WORD_BITS; ++i)
+      n += std::popcount (words_[i]);
+    return n + std::popcount (words_[t / WORD_BITS] & (bit_of (t) - 1));
+  }
+
+  size_t
+  popcount () const
   {
-    for (size_t i = 0; i < taint::N; ++i)
+    size_t n = 0;
+    for (auto word : words_)
+      n += std::popcount (word);
+    return n;
+  }
+
+  /* Call F on every taint in the set in ascending order */
+  template <typename F>
+  void
+  for_each_set (F &&f) const
+  {
+    for (size_t i = 0; i < NWORD; ++i)
       {
-        if (set_.test (i))
+        for (auto word = words_[i]; word; word &= word - 1)
           {
-            return const_iterator{ taint{ i }, *this };
+            f (taint{ i * WORD_BITS + std::countr_zero (word) });
           }
       }
-    return const_iterator{ taint{ taint::N }, *this };
+  }
+
+  /* The NWORD words holding the set, for the bulk kernels */
+  word_type *
+  data ()
+  {
+    return words_.data ();
+  }
+
+  const word_type *
+  data () const
+  {
+    return words_.data ();
+  }
+
+  /* Call F on every taint in the set but not in OTHER in ascending order */
+  template <typename F>
+  void
+  for_each_set_but (const taint_set &other, F &&f) const
+  {
+    for (size_t i = 0; i < NWORD; ++i)
+      {
+        for (auto word = words_[i] & ~other.words_[i]; word; word &= word - 1)
+          {
+            f (taint{ i * WORD_BITS + std::countr_zero (word) });
+          }
+      }
+  }
+
+  const_iterator
+  begin () const
+  {
+    return const_iterator{ find_next (0), *this };
   }
 
   const_iterator
   end () const
   {
-    return const_iterator{ taint{ taint::N }, *this };
+    return const_iterator{ taint{ N }, *this };
   }
 
 private:
-  std::bitset<taint::N> set_ = {};
+  static constexpr word_type
+  bit_of (taint t)
+  {
+    return word_type{ 1 } << (t % WORD_BITS);
+  }
+
+  /* Return the first taint in the set from I on, or taint{ N } */
+  taint
+  find_next (size_t i) const
+  {
+    if (i >= N)
+      return taint{ N };
+
+    auto w = i / WORD_BITS;
+    auto word = words_[w] & (~word_type{ 0 } << (i % WORD_BITS));
+    while (!word && ++w < NWORD)
+      word = words_[w];
+
+    return word ? taint{ w * WORD_BITS + std::countr_zero (word) }
+                : taint{ N };
+  }
+
+  static constexpr size_t ALIGN = std::min<size_t> (64, N / 8);
+
+  alignas (ALIGN) std::array<word_type, NWORD> words_ = {};
 };
 
-inline taint_set
-operator| (taint_set lhs, taint_set rhs)
+template <size_t N>
+inline taint_set<N>
+operator| (taint_set<N> lhs, const taint_set<N> &rhs)
 {
   return lhs |= rhs;
 }
@@ -0,0 +1,187 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "taint-simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace clueless
+{
+
+/* Union words FROM..NWORD of the sources, left over by a wider kernel */
+static void
+or_reduce_tail (uint64_t *dst, const uint64_t *const *srcs, size_t nsrc,
+                size_t from, size_t nword)
+{
+  for (size_t i = from; i < nword; ++i)
+    {
+      uint64_t word = 0;
+      for (size_t s = 0; s < nsrc; ++s)
+        word |= srcs[s][i];
+      dst[i] = word;
+    }
+}
+
+static void
+or_reduce_scalar (uint64_t *dst, const uint64_t *const *srcs, size_t nsrc,
+                  size_t nword)
+{
+  or_reduce_tail (dst, srcs, nsrc, 0, nword);
+}
+
+static bool
+any_scalar (const uint64_t *words, size_t nword)
+{
+  uint64_t acc = 0;
+  for (size_t i = 0; i < nword; ++i)
+    acc |= words[i];
+  return acc;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__ ((target ("sse2"))) static void
+or_reduce_sse2 (uint64_t *dst, const uint64_t *const *srcs, size_t nsrc,
+                size_t nword)
+{
+  size_t i = 0;
+  for (; i + 2 <= nword; i += 2)
+    {
+      auto acc = _mm_setzero_si128 ();
+      for (size_t s = 0; s < nsrc; ++s)
+        acc = _mm_or_si128 (acc,
+                            _mm_loadu_si128 ((const __m128i *)(srcs[s] + i)));
+      _mm_storeu_si128 ((__m128i *)(dst + i), acc);
+    }
+  or_reduce_tail (dst, srcs, nsrc, i, nword);
+}
+
+__attribute__ ((target ("sse2"))) static bool
+any_sse2 (const uint64_t *words, size_t nword)
+{
+  auto acc = _mm_setzero_si128 ();
+  size_t i = 0;
+  for (; i + 2 <= nword; i += 2)
+    acc = _mm_or_si128 (acc, _mm_loadu_si128 ((const __m128i *)(words + i)));
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (acc, _mm_setzero_si128 ()))
+             != 0xffff
+         || any_scalar (words + i, nword - i);
+}
+
+__attribute__ ((target ("avx2"))) static void
+or_reduce_avx2 (uint64_t *dst, const uint64_t *const *srcs, size_t nsrc,
+                size_t nword)
+{
+  size_t i = 0;
+  for (; i + 4 <= nword; i += 4)
+    {
+      auto acc = _mm256_setzero_si256 ();
+      for (size_t s = 0; s < nsrc; ++s)
+        acc = _mm256_or_si256 (
+            acc, _mm256_loadu_si256 ((const __m256i *)(srcs[s] + i)));
+      _mm256_storeu_si256 ((__m256i *)(dst + i), acc);
+    }
+  or_reduce_tail (dst, srcs, nsrc, i, nword);
+}
+
+__attribute__ ((target ("avx2"))) static bool
+any_avx2 (const uint64_t *words, size_t nword)
+{
+  auto acc = _mm256_setzero_si256 ();
+  size_t i = 0;
+  for (; i + 4 <= nword; i += 4)
+    acc = _mm256_or_si256 (acc,
+                           _mm256_loadu_si256 ((const __m256i *)(words + i)));
+  return !_mm256_testz_si256 (acc, acc) || any_scalar (words + i, nword - i);
+}
+
+__attribute__ ((target ("avx512f"))) static void
+or_reduce_avx512 (uint64_t *dst, const uint64_t *const *srcs, size_t nsrc,
+                  size_t nword)
+{
+  size_t i = 0;
+  for (; i + 8 <= nword; i += 8)
+    {
+      auto acc = _mm512_setzero_si512 ();
+      for (size_t s = 0; s < nsrc; ++s)
+        acc = _mm512_or_si512 (acc, _mm512_loadu_si512 (srcs[s] + i));
+      _mm512_storeu_si512 (dst + i, acc);
+    }
+  or_reduce_tail (dst, srcs, nsrc, i, nword);
+}
+
+__attribute__ ((target ("avx512f"))) static bool
+any_avx512 (const uint64_t *words, size_t nword)
+{
+  auto acc = _mm512_setzero_si512 ();
+  size_t i = 0;
+  for (; i + 8 <= nword; i += 8)
+    acc = _mm512_or_si512 (acc, _mm512_loadu_si512 (words + i));
+  return _mm512_test_epi64_mask (acc, acc) || any_avx2 (words + i, nword - i);
+}
+#endif
+
+simd_isa
+detect_simd_isa ()
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512f"))
+    return simd_isa::AVX512;
+  if (__builtin_cpu_supports ("avx2"))
+    return simd_isa::AVX2;
+  if (__builtin_cpu_supports ("sse2"))
+    return simd_isa::SSE2;
+#endif
+  return simd_isa::SCALAR;
+}
+
+const taint_kernels &
+taint_kernels_for (simd_isa isa)
+{
+  static constexpr auto scalar = taint_kernels{ or_reduce_scalar, any_scalar };
+
+#ifdef HAVE_X86_SIMD
+  static constexpr auto sse2 = taint_kernels{ or_reduce_sse2, any_sse2 };
+  static constexpr auto avx2 = taint_kernels{ or_reduce_avx2, any_avx2 };
+  static constexpr auto avx512 = taint_kernels{ or_reduce_avx512, any_avx512 };
+
+  switch (isa)
+    {
+    case simd_isa::AVX512:
+      return avx512;
+    case simd_isa::AVX2:
+      return avx2;
+    case simd_isa::SSE2:
+      return sse2;
+    default:
+      break;
+    }
+#endif
+
+  return scalar;
+}
+
+const taint_kernels active_taint_kernels
+    = taint_kernels_for (detect_simd_isa ());
+
+}
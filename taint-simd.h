@@ -0,0 +1,59 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TAINT_SIMD_H
+#define TAINT_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace clueless
+{
+
+enum class simd_isa
+{
+  SCALAR,
+  SSE2,
+  AVX2,
+  AVX512,
+};
+
+/* Bulk operations over the 64-bit words of taint sets */
+struct taint_kernels
+{
+  /* Set DST to the union of the NSRC word arrays in SRCS */
+  void (*or_reduce) (uint64_t *dst, const uint64_t *const *srcs,
+                     size_t nsrc, size_t nword);
+
+  /* Tell whether any of the NWORD words is non-zero */
+  bool (*any) (const uint64_t *words, size_t nword);
+};
+
+/* Return the widest instruction set this CPU supports */
+simd_isa detect_simd_isa ();
+
+const taint_kernels &taint_kernels_for (simd_isa isa);
+
+/* The kernels for this CPU, selected at startup */
+extern const taint_kernels active_taint_kernels;
+
+}
+
+#endif
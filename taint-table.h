@@ -23,58 +23,285 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <ranges>
+#include <vector>
 
 #include "taint-set.h"
 
 namespace clueless
 {
 
-class reg_taint_table
+/* How far a taint has travelled through one register */
+struct taint_state
+{
+  static constexpr uint8_t MAX_LEVEL = UINT8_MAX;
+
+  uint8_t level; /* register to register hops, saturating at MAX_LEVEL */
+  uint16_t age;  /* reads of the register left before the taint fades */
+};
+
+/*
+ * Taint sets of all registers. Each register also keeps a taint_state
+ * for every taint it holds, packed in ascending taint order so that
+ * the states take space only for live taints.
+ *
+ * Ages are kept as the read count of the register at which the taint
+ * fades, so reading a register only bumps its count. Faded taints are
+ * swept out on the read that passes the earliest expiry in the
+ * register, which makes the table look exactly as if every age were
+ * decremented on every read.
+ *
+ * A reverse index from each taint to the registers that may hold it
+ * lets a taint be dropped from the table without visiting every
+ * register. The index is a superset: a taint leaving a register leaves
+ * its bit behind, which only costs a wasted visit when the taint is
+ * recycled.
+ */
+template <size_t N = taint::N, size_t NREG = 256> class reg_taint_table
 {
 public:
-  static constexpr size_t NREG = 256;
+  static_assert (NREG % 64 == 0);
 
+  using taint_set = clueless::taint_set<N>;
   using value_type = taint_set;
-  using reference = taint_set &;
   using const_reference = const value_type &;
 
-  constexpr const_reference &
+  reg_taint_table () = default;
+
+  /* Copy a table of fewer registers, leaving the others untainted */
+  template <size_t M>
+  explicit reg_taint_table (const reg_taint_table<N, M> &other)
+  {
+    static_assert (M <= NREG);
+    using namespace std::ranges;
+    copy (other.table_, table_.begin ());
+    for (size_t reg = 0; reg < M; ++reg)
+      for (auto e : other.entries_[reg])
+        entries_[reg].push_back (
+            entry{ .expiry = e.expiry, .level = e.level });
+    copy (other.reads_, reads_.begin ());
+    copy (other.next_expiry_, next_expiry_.begin ());
+    for (size_t t = 0; t < N; ++t)
+      other.holders_[t].for_each_set (
+          [&, this] (auto reg) { holders_[t].add (reg); });
+    other.tainted_.for_each_set ([this] (auto reg) { tainted_.add (reg); });
+  }
+
+  constexpr const_reference
   operator[] (size_t reg) const
   {
     return table_[reg];
   }
 
-  constexpr reference &
-  operator[] (size_t reg)
+  /* Set the taints of REG to TS, taking the state of each from F (T) */
+  template <typename F>
+  void
+  assign (size_t reg, const taint_set &ts, F &&f)
   {
-    return table_[reg];
+    /* Taints already in the register are indexed already */
+    ts.for_each_set_but (table_[reg],
+                         [=, this] (auto t) { holders_[t].add (reg); });
+    table_[reg] = ts;
+
+    auto &entries = entries_[reg];
+    auto &next = next_expiry_[reg];
+    entries.clear ();
+    next = reads_[reg] + NEVER;
+    ts.for_each_set ([&, this] (auto t) {
+      auto e = entry_of (reg, f (t));
+      entries.push_back (e);
+      if (before (e.expiry, next))
+        next = e.expiry;
+    });
+    tainted_.set (reg, !entries.empty ());
   }
 
+  /* Make T the only taint of REG */
   void
-  remove_all (taint t)
+  assign (size_t reg, taint t, taint_state state)
+  {
+    holders_[t].add (reg);
+    table_[reg] = taint_set{}.add (t);
+    entries_[reg].assign (1, entry_of (reg, state));
+    next_expiry_[reg] = entries_[reg].front ().expiry;
+    tainted_.add (reg);
+  }
+
+  /* Remove every taint from REG */
+  void
+  clear (size_t reg)
+  {
+    if (!tainted_.test (reg))
+      return;
+
+    table_[reg] = taint_set{};
+    entries_[reg].clear ();
+    tainted_.remove (reg);
+  }
+
+  /* Tell whether REG holds any taint */
+  bool
+  tainted (size_t reg) const
+  {
+    return tainted_.test (reg);
+  }
+
+  /* Age every taint of REG by one read, dropping those that fade */
+  void
+  read (size_t reg)
   {
-    for (auto &ts : table_)
-      {
+    auto reads = ++reads_[reg];
+    if (!before (next_expiry_[reg], reads))
+      return;
+
+    auto &ts = table_[reg];
+    auto &entries = entries_[reg];
+    auto &next = next_expiry_[reg];
+    auto kept = entries.begin (), e = entries.begin ();
+    next = reads + NEVER;
+    ts.for_each_set ([&] (auto t) {
+      if (before (e->expiry, reads))
         ts.remove (t);
-      }
+      else
+        {
+          if (before (e->expiry, next))
+            next = e->expiry;
+          *kept++ = *e;
+        }
+      ++e;
+    });
+    entries.erase (kept, entries.end ());
+    tainted_.set (reg, !entries.empty ());
+  }
+
+  /* Call F (T, STATE) on every taint of REG in ascending order */
+  template <typename F>
+  void
+  for_each (size_t reg, F &&f) const
+  {
+    auto e = entries_[reg].begin ();
+    table_[reg].for_each_set ([&, this] (auto t) {
+      f (t, taint_state{ .level = e->level,
+                         .age = uint16_t (e->expiry - reads_[reg]) });
+      ++e;
+    });
+  }
+
+  void
+  remove_all (taint t)
+  {
+    holders_[t].for_each_set ([=, this] (auto reg) {
+      if (table_[reg].test (t))
+        {
+          auto &entries = entries_[reg];
+          entries.erase (entries.begin () + table_[reg].rank (t));
+          table_[reg].remove (t);
+          tainted_.set (reg, !entries.empty ());
+        }
+    });
+    holders_[t] = {};
   }
 
   size_t
   count (taint t) const
   {
-    using namespace std::ranges;
-    return count_if (table_, [=] (auto ts) { return ts.test (t); });
+    size_t n = 0;
+    holders_[t].for_each_set (
+        [&, this] (auto reg) { n += table_[reg].test (t); });
+    return n;
   }
 
 private:
+  template <size_t, size_t> friend class reg_taint_table;
+
+  class reg_mask
+  {
+  public:
+    void
+    add (size_t reg)
+    {
+      words_[reg / 64] |= bit_of (reg);
+    }
+
+    void
+    remove (size_t reg)
+    {
+      words_[reg / 64] &= ~bit_of (reg);
+    }
+
+    void
+    set (size_t reg, bool value)
+    {
+      value ? add (reg) : remove (reg);
+    }
+
+    bool
+    test (size_t reg) const
+    {
+      return words_[reg / 64] & bit_of (reg);
+    }
+
+    template <typename F>
+    void
+    for_each_set (F &&f) const
+    {
+      for (size_t i = 0; i < words_.size (); ++i)
+        {
+          for (auto word = words_[i]; word; word &= word - 1)
+            {
+              f (i * 64 + std::countr_zero (word));
+            }
+        }
+    }
+
+  private:
+    static constexpr uint64_t
+    bit_of (size_t reg)
+    {
+      return uint64_t{ 1 } << (reg % 64);
+    }
+
+    std::array<uint64_t, NREG / 64> words_ = {};
+  };
+
+  /* A taint_state with the age turned into an expiry read count */
+  struct entry
+  {
+    uint32_t expiry;
+    uint8_t level;
+  };
+
+  /* Expiry far enough out to never be reached before the next sweep */
+  static constexpr uint32_t NEVER = INT32_MAX;
+
+  /* Tell whether read count A comes before B, allowing for wrap around */
+  static constexpr bool
+  before (uint32_t a, uint32_t b)
+  {
+    return int32_t (a - b) < 0;
+  }
+
+  entry
+  entry_of (size_t reg, taint_state state) const
+  {
+    return entry{ .expiry = reads_[reg] + state.age, .level = state.level };
+  }
+
   std::array<value_type, NREG> table_ = {};
+  std::array<std::vector<entry>, NREG> entries_ = {};
+  std::array<uint32_t, NREG> reads_ = {};
+  std::array<uint32_t, NREG> next_expiry_ = {};
+  std::array<reg_mask, N> holders_ = {};
+  /* Registers holding any taint */
+  reg_mask tainted_ = {};
 };
 
-class taint_address_table
+template <size_t N = taint::N> class taint_address_table
 {
 public:
   using value_type = unsigned long long;
@@ -84,19 +311,19 @@ public:
   constexpr const_reference &
   operator[] (taint t) const
   {
-    assert (t < taint::N);
+    assert (t < N);
     return table_[t];
   }
 
   constexpr reference &
   operator[] (taint t)
   {
-    assert (t < taint::N);
+    assert (t < N);
     return table_[t];
   }
 
 private:
-  std::array<value_type, taint::N> table_;
+  std::array<value_type, N> table_;
 };
 
 }
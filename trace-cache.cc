@@ -0,0 +1,168 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace-cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+namespace clueless
+{
+
+trace_cache_writer::trace_cache_writer (const char *_cs) : cache_string (_cs)
+{
+  cache_file = fopen (cache_string.c_str (), "wb");
+  if (cache_file == NULL)
+    {
+      std::cerr << std::endl
+                << "*** CANNOT OPEN TRACE CACHE: " << cache_string << " ***"
+                << std::endl;
+      assert (0);
+    }
+
+  /* Reserve the header, filled in when the record count is known */
+  auto header = trace_cache_header{};
+  fwrite (&header, sizeof (header), 1, cache_file);
+}
+
+trace_cache_writer::~trace_cache_writer ()
+{
+  auto header = trace_cache_header{};
+  std::copy_n (trace_cache_header::MAGIC, sizeof (header.magic),
+               header.magic);
+  header.version = trace_cache_header::VERSION;
+  header.record_size = sizeof (cached_instr);
+  header.nrecord = nrecord;
+
+  fseek (cache_file, 0, SEEK_SET);
+  fwrite (&header, sizeof (header), 1, cache_file);
+  if (fclose (cache_file))
+    {
+      std::cerr << std::endl
+                << "*** CANNOT WRITE TRACE CACHE: " << cache_string << " ***"
+                << std::endl;
+      assert (0);
+    }
+}
+
+void
+trace_cache_writer::write (const propagator::instr &ins)
+{
+  auto record = cached_instr{ ins.ip,      ins.address, ins.op,
+                              ins.src_reg, ins.dst_reg, ins.mem_reg };
+  if (fwrite (&record, sizeof (record), 1, cache_file) != 1)
+    {
+      std::cerr << std::endl
+                << "*** CANNOT WRITE TRACE CACHE: " << cache_string << " ***"
+                << std::endl;
+      assert (0);
+    }
+  ++nrecord;
+}
+
+trace_cache_reader::trace_cache_reader (const char *_cs)
+    : cache_file (_cs), cache_string (_cs)
+{
+  if (!is_trace_cache (_cs) || !cache_file.good ())
+    {
+      std::cerr << std::endl
+                << "*** CANNOT OPEN TRACE CACHE: " << cache_string << " ***"
+                << std::endl;
+      assert (0);
+    }
+
+  auto data = cache_file.data ();
+  auto header = (const trace_cache_header *)data.data ();
+  if (header->version != trace_cache_header::VERSION
+      || header->record_size != sizeof (cached_instr)
+      || !header->nrecord
+      || data.size () < sizeof (*header)
+                            + header->nrecord * sizeof (cached_instr))
+    {
+      std::cerr << std::endl
+                << "*** CORRUPTED TRACE CACHE: " << cache_string << " ***"
+                << std::endl;
+      assert (0);
+    }
+
+  records = { (const cached_instr *)(data.data () + sizeof (*header)),
+              header->nrecord };
+}
+
+bool
+trace_cache_reader::is_trace_cache (const char *path)
+{
+  auto header = trace_cache_header{};
+  auto file = fopen (path, "rb");
+  if (file == NULL)
+    return false;
+  auto n = fread (&header, sizeof (header), 1, file);
+  fclose (file);
+  return n == 1
+         && !memcmp (header.magic, trace_cache_header::MAGIC,
+                     sizeof (header.magic));
+}
+
+cached_instr
+trace_cache_reader::read_single_instr ()
+{
+  if (pos == records.size ())
+    rewind ();
+
+  return records[pos++];
+}
+
+std::span<const cached_instr>
+trace_cache_reader::next_block ()
+{
+  if (pos == records.size ())
+    rewind ();
+
+  auto block
+      = records.subspan (pos, std::min (BLOCK_SIZE, records.size () - pos));
+  pos += block.size ();
+  return block;
+}
+
+void
+trace_cache_reader::skip (size_t n)
+{
+  while (n)
+    {
+      if (pos == records.size ())
+        rewind ();
+
+      auto nskipped = std::min (n, records.size () - pos);
+      pos += nskipped;
+      n -= nskipped;
+    }
+}
+
+void
+trace_cache_reader::rewind ()
+{
+  // reached end of file for this trace
+  std::cout << "*** Reached end of trace: " << cache_string << std::endl;
+  pos = 0;
+}
+
+}
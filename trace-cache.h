@@ -0,0 +1,141 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_CACHE_H
+#define TRACE_CACHE_H
+
+#include "mapped-file.h"
+#include "propagator.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <type_traits>
+
+namespace clueless
+{
+
+/*
+ * A clueless trace cache holds the decoded instruction stream of a
+ * trace as fixed-width records following a header, so that it can be
+ * replayed straight out of a memory mapping.
+ */
+struct trace_cache_header
+{
+  static constexpr char MAGIC[8] = { 'C', 'L', 'U', 'E', 'T', 'C', 'C', 0 };
+  static constexpr uint32_t VERSION = 4;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t nrecord;
+  uint64_t reserved;
+};
+
+/*
+ * A record is a decoded instruction less its sequence number, which
+ * trace_cache_decoder counts afresh like champsim_trace_decoder does
+ */
+struct cached_instr
+{
+  unsigned long long ip;
+  unsigned long long address;
+  propagator::instr::opcode op;
+  propagator::instr::reg_set src_reg;
+  propagator::instr::reg_set dst_reg;
+  propagator::instr::reg_set mem_reg;
+};
+
+static_assert (sizeof (trace_cache_header) == 32);
+static_assert (sizeof (cached_instr) == 32
+               && std::is_trivially_copyable_v<cached_instr>);
+
+class trace_cache_writer
+{
+public:
+  explicit trace_cache_writer (const char *cache_string);
+  trace_cache_writer (const trace_cache_writer &other) = delete;
+  ~trace_cache_writer ();
+
+  void write (const propagator::instr &ins);
+
+private:
+  FILE *cache_file = NULL;
+  std::string cache_string;
+  uint64_t nrecord = 0;
+};
+
+class trace_cache_reader
+{
+public:
+  explicit trace_cache_reader (const char *cache_string);
+  trace_cache_reader (const trace_cache_reader &other) = delete;
+
+  /* Tell whether PATH starts with a trace cache header */
+  static bool is_trace_cache (const char *path);
+
+  cached_instr read_single_instr ();
+
+  /*
+   * Return the next block of records straight out of the mapping. The
+   * block stays valid as long as the reader.
+   */
+  std::span<const cached_instr> next_block ();
+
+  /* Skip the next N records */
+  void skip (size_t n);
+
+private:
+  static constexpr size_t BLOCK_SIZE = 1 << 14;
+
+  void rewind ();
+
+  mapped_file cache_file;
+  std::string cache_string;
+  std::span<const cached_instr> records;
+  size_t pos = 0;
+};
+
+/* Turns records back into instructions so a cache can stand in for a trace */
+class trace_cache_decoder
+{
+public:
+  const propagator::instr &
+  decode (const cached_instr &input)
+  {
+    ins_.ip = input.ip;
+    ins_.seq = i_++;
+    ins_.address = input.address;
+    ins_.op = input.op;
+    ins_.src_reg = input.src_reg;
+    ins_.dst_reg = input.dst_reg;
+    ins_.mem_reg = input.mem_reg;
+    return ins_;
+  }
+
+private:
+  propagator::instr ins_ = {};
+  unsigned long long i_ = {};
+};
+
+}
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace-index.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace clueless
+{
+
+struct gzip_index_header
+{
+  static constexpr char MAGIC[8] = { 'C', 'L', 'U', 'E', 'G', 'Z', 'I', 0 };
+  static constexpr uint32_t VERSION = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t window_size;
+  uint64_t npoint;
+  uint64_t trace_size;
+};
+
+static uint64_t
+file_size (const std::string &path)
+{
+  struct stat st;
+  return stat (path.c_str (), &st) ? 0 : st.st_size;
+}
+
+bool
+gzip_index::build (const std::string &trace_string, size_t span)
+{
+#ifdef HAVE_ZLIB
+  auto file = fopen (trace_string.c_str (), "rb");
+  if (file == NULL)
+    return false;
+
+  points_.clear ();
+  trace_size_ = file_size (trace_string);
+
+  auto strm = z_stream{};
+  if (inflateInit2 (&strm, 15 + 32) != Z_OK)
+    {
+      fclose (file);
+      return false;
+    }
+
+  auto in = std::vector<uint8_t> (1 << 20);
+  auto window = std::vector<uint8_t> (gzip_access_point::WINDOW_SIZE);
+  uint64_t totin = 0, totout = 0, last = 0;
+  auto good = true;
+
+  for (;;)
+    {
+      if (!strm.avail_in)
+        {
+          strm.avail_in = fread (in.data (), 1, in.size (), file);
+          strm.next_in = in.data ();
+          if (!strm.avail_in)
+            {
+              good = false;
+              break;
+            }
+        }
+
+      /* Decompress into the window in circles, keeping the last 32K */
+      if (!strm.avail_out)
+        {
+          strm.avail_out = window.size ();
+          strm.next_out = window.data ();
+        }
+
+      totin += strm.avail_in;
+      totout += strm.avail_out;
+      auto ret = inflate (&strm, Z_BLOCK);
+      totin -= strm.avail_in;
+      totout -= strm.avail_out;
+
+      if (ret == Z_STREAM_END)
+        {
+          /* Another gzip member may follow */
+          if (!strm.avail_in)
+            {
+              strm.avail_in = fread (in.data (), 1, in.size (), file);
+              strm.next_in = in.data ();
+            }
+          if (!strm.avail_in)
+            break;
+          inflateReset (&strm);
+          continue;
+        }
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+          good = false;
+          break;
+        }
+
+      /* At the end of a deflate block that is not the last one */
+      auto at_block_boundary
+          = (strm.data_type & 128) && !(strm.data_type & 64);
+      if (at_block_boundary && (points_.empty () || totout - last >= span))
+        {
+          auto &point = points_.emplace_back ();
+          point.out = totout;
+          point.in = totin;
+          point.bits = strm.data_type & 7;
+
+          auto left = strm.avail_out;
+          std::copy (window.end () - left, window.end (), point.window);
+          std::copy (window.begin (), window.end () - left,
+                     point.window + left);
+          last = totout;
+        }
+    }
+
+  inflateEnd (&strm);
+  fclose (file);
+  return good;
+#else
+  return false;
+#endif
+}
+
+bool
+gzip_index::load (const std::string &trace_string)
+{
+  auto file = fopen (path_of (trace_string).c_str (), "rb");
+  if (file == NULL)
+    return false;
+
+  auto header = gzip_index_header{};
+  auto good = fread (&header, sizeof (header), 1, file) == 1
+              && !memcmp (header.magic, gzip_index_header::MAGIC,
+                          sizeof (header.magic))
+              && header.version == gzip_index_header::VERSION
+              && header.window_size == gzip_access_point::WINDOW_SIZE
+              && header.trace_size == file_size (trace_string);
+
+  if (good)
+    {
+      points_.resize (header.npoint);
+      trace_size_ = header.trace_size;
+      good = fread (points_.data (), sizeof (gzip_access_point),
+                    points_.size (), file)
+             == points_.size ();
+    }
+
+  if (!good)
+    points_.clear ();
+
+  fclose (file);
+  return good;
+}
+
+bool
+gzip_index::save (const std::string &trace_string) const
+{
+  auto file = fopen (path_of (trace_string).c_str (), "wb");
+  if (file == NULL)
+    return false;
+
+  auto header = gzip_index_header{};
+  std::copy_n (gzip_index_header::MAGIC, sizeof (header.magic),
+               header.magic);
+  header.version = gzip_index_header::VERSION;
+  header.window_size = gzip_access_point::WINDOW_SIZE;
+  header.npoint = points_.size ();
+  header.trace_size = trace_size_;
+
+  auto good = fwrite (&header, sizeof (header), 1, file) == 1
+              && fwrite (points_.data (), sizeof (gzip_access_point),
+                         points_.size (), file)
+                     == points_.size ();
+  return !fclose (file) && good;
+}
+
+const gzip_access_point *
+gzip_index::find (uint64_t out) const
+{
+  auto it = std::upper_bound (
+      points_.begin (), points_.end (), out,
+      [] (auto out, const auto &point) { return out < point.out; });
+  return it == points_.begin () ? nullptr : &*(it - 1);
+}
+
+}
@@ -0,0 +1,86 @@
+/*
+ * clueless --- Characterises vaLUEs Leaking as addrESSes
+ * Copyright (C) 2023  Xiaoyue Chen
+ *
+ * This file is part of clueless.
+ *
+ * clueless is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * clueless is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with clueless.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_INDEX_H
+#define TRACE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace clueless
+{
+
+/*
+ * A point in a gzip trace where decompression can restart, in the
+ * manner of zlib's examples/zran.c. Restarting takes the last 32 KiB
+ * of output as the dictionary, plus the bits of the byte before IN
+ * that belong to the next deflate block.
+ */
+struct gzip_access_point
+{
+  static constexpr size_t WINDOW_SIZE = 32768;
+
+  uint64_t out;
+  uint64_t in;
+  uint32_t bits;
+  uint8_t window[WINDOW_SIZE];
+};
+
+/*
+ * Sidecar index of a gzip trace, kept next to it in TRACE.idx. It lets
+ * a reader fast-forward to any instruction by decompressing from the
+ * nearest access point instead of from the start of the trace.
+ */
+class gzip_index
+{
+public:
+  static std::string
+  path_of (const std::string &trace_string)
+  {
+    return trace_string + ".idx";
+  }
+
+  /* Scan TRACE for an access point every SPAN uncompressed bytes */
+  bool build (const std::string &trace_string, size_t span);
+
+  /* Load the index of TRACE, failing if it is missing or stale */
+  bool load (const std::string &trace_string);
+
+  bool save (const std::string &trace_string) const;
+
+  /* Return the last access point at or before OUT, or nullptr */
+  const gzip_access_point *find (uint64_t out) const;
+
+  size_t
+  size () const
+  {
+    return points_.size ();
+  }
+
+private:
+  std::vector<gzip_access_point> points_;
+  uint64_t trace_size_ = 0;
+};
+
+}
+
+#endif
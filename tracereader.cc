@@ -15,6 +15,7 @@
  */
 
 #include "tracereader.h"
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <iostream>
@@ -22,26 +23,22 @@
 namespace clueless
 {
 
-tracereader::tracereader (const char *_ts) : trace_string (_ts)
+tracereader::tracereader (const char *_ts, unsigned _nthread)
+    : trace_string (_ts), nthread (_nthread)
 {
-  std::string last_dot = trace_string.substr (trace_string.find_last_of ("."));
-
   std::ifstream testfile (trace_string);
   if (!testfile.good ())
     {
       std::cerr << "TRACE FILE NOT FOUND" << std::endl;
       assert (0);
     }
-  cmd_fmtstr = "%1$s -dc %2$s";
 
-  if (last_dot[1] == 'g') // gzip format
-    decomp_program = "gzip";
-  else if (last_dot[1] == 'x') // xz
-    decomp_program = "xz";
+  if (auto c = compression_of (trace_string))
+    trace_compression = *c;
   else
     {
-      std::cout << "ChampSim does not support traces other than gz or xz "
-                   "compression!"
+      std::cout << "ChampSim does not support traces other than gz, xz or "
+                   "zst compression!"
                 << std::endl;
       assert (0);
     }
@@ -54,9 +51,78 @@ tracereader::~tracereader () { close (); }
 input_instr
 tracereader::read_single_instr ()
 {
-  input_instr trace_read_instr;
+  if (buffer_begin == buffer_end)
+    refill ();
+
+  return buffer[buffer_begin++];
+}
+
+void
+tracereader::read_batch (std::span<input_instr> out)
+{
+  auto nbuffered = std::min (out.size (), buffer_end - buffer_begin);
+  std::copy_n (buffer.begin () + buffer_begin, nbuffered, out.begin ());
+  buffer_begin += nbuffered;
+
+  /* Decompress the rest straight into OUT */
+  for (out = out.subspan (nbuffered); !out.empty ();)
+    {
+      out = out.subspan (fill (out));
+    }
+}
+
+std::span<const input_instr>
+tracereader::next_block ()
+{
+  if (buffer_begin == buffer_end)
+    refill ();
+
+  auto block = std::span{ buffer }.subspan (buffer_begin,
+                                           buffer_end - buffer_begin);
+  buffer_begin = buffer_end;
+  return block;
+}
+
+void
+tracereader::skip (size_t n)
+{
+  constexpr auto record_size = sizeof (input_instr);
+
+  auto nbuffered = std::min (n, buffer_end - buffer_begin);
+  buffer_begin += nbuffered;
 
-  while (!fread (&trace_read_instr, sizeof (trace_read_instr), 1, trace_file))
+  for (n -= nbuffered; n;)
+    {
+      auto nskipped = trace_file->skip (n * record_size) / record_size;
+      if (nskipped < n)
+        {
+          // reached end of file for this trace
+          std::cout << "*** Reached end of trace: " << trace_string
+                    << std::endl;
+
+          // close the trace file and re-open it
+          close ();
+          open (trace_string);
+        }
+      n -= nskipped;
+    }
+}
+
+void
+tracereader::refill ()
+{
+  buffer_begin = 0;
+  buffer_end = fill (buffer);
+}
+
+size_t
+tracereader::fill (std::span<input_instr> out)
+{
+  constexpr auto record_size = sizeof (input_instr);
+
+  size_t nread;
+  while (!(nread = trace_file->read ((char *)out.data (), out.size_bytes ())
+                   / record_size))
     {
       // reached end of file for this trace
       std::cout << "*** Reached end of trace: " << trace_string << std::endl;
@@ -66,32 +132,19 @@ tracereader::read_single_instr ()
       open (trace_string);
     }
 
-  return trace_read_instr;
+  return nread;
 }
 
 void
 tracereader::open (std::string trace_string)
 {
-  char gunzip_command[4096];
-  sprintf (gunzip_command, cmd_fmtstr.c_str (), decomp_program.c_str (),
-           trace_string.c_str ());
-  trace_file = popen (gunzip_command, "r");
-  if (trace_file == NULL)
-    {
-      std::cerr << std::endl
-                << "*** CANNOT OPEN TRACE FILE: " << trace_string << " ***"
-                << std::endl;
-      assert (0);
-    }
+  trace_file = open_decompressor (trace_string, trace_compression, nthread);
 }
 
 void
 tracereader::close ()
 {
-  if (trace_file != NULL)
-    {
-      pclose (trace_file);
-    }
+  trace_file.reset ();
 }
 
 }
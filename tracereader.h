@@ -17,9 +17,13 @@
 #ifndef TRACEREADER_H
 #define TRACEREADER_H
 
+#include "decompressor.h"
 #include "trace-instruction.h"
-#include <cstdio>
+#include <cstddef>
+#include <memory>
+#include <span>
 #include <string>
+#include <vector>
 
 namespace clueless
 {
@@ -27,20 +31,38 @@ namespace clueless
 class tracereader
 {
 public:
-  explicit tracereader (const char *trace_string);
+  explicit tracereader (const char *trace_string, unsigned nthread = 1);
   tracereader (const tracereader &other) = delete;
   ~tracereader ();
 
   input_instr read_single_instr ();
 
+  /* Fill OUT with the next OUT.size () records. */
+  void read_batch (std::span<input_instr> out);
+
+  /*
+   * Return the next block of records without copying them. The block
+   * stays valid until the next read from this reader.
+   */
+  std::span<const input_instr> next_block ();
+
+  /* Skip the next N records, jumping ahead where the trace allows */
+  void skip (size_t n);
+
 private:
+  static constexpr size_t BUFFER_SIZE = 1 << 14;
+
   void open (std::string trace_string);
   void close ();
+  void refill ();
+  size_t fill (std::span<input_instr> out);
 
-  FILE *trace_file = NULL;
+  std::unique_ptr<decompressor> trace_file;
   std::string trace_string;
-  std::string cmd_fmtstr;
-  std::string decomp_program;
+  compression trace_compression;
+  unsigned nthread;
+  std::vector<input_instr> buffer = std::vector<input_instr> (BUFFER_SIZE);
+  size_t buffer_begin = 0, buffer_end = 0;
 };
 
 }